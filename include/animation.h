@@ -0,0 +1,50 @@
+/********************************
+ * Keyframed motion of a scene's spheres and light0 over a sequence of
+ * frames.
+ *
+ * A key fixes where one sphere (its center and radius) or light0 is at
+ * one frame. Between two keys of the same thing it moves in a straight
+ * line, before its first key and after its last it stays put, and
+ * anything without keys keeps the place the scene gives it. Posing the
+ * scene for a frame moves what the keys say and refits the bounding
+ * volume hierarchy around the spheres' new places, only building it
+ * again once they have moved so far that the refit tree is slow.
+ ********************************/
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "geometry.h"
+
+struct scene_struct;
+
+/*where sphere (an index into the scene's list) is at frame*/
+typedef struct sphere_key_struct {
+    int frame;
+    int sphere;
+    sphere s;
+} sphere_key;
+
+/*where light0 is at frame*/
+typedef struct light_key_struct {
+    int frame;
+    point location;
+} light_key;
+
+typedef struct animation_struct {
+    int frame_count;        /*frames in the sequence, 0 for a still scene*/
+    /*sorted by sphere then frame once sort_keys has run*/
+    sphere_key * sphere_keys;
+    int sphere_key_count, sphere_key_capacity;
+    /*sorted by frame once sort_keys has run*/
+    light_key * light_keys;
+    int light_key_count, light_key_capacity;
+} animation;
+
+void init_animation(animation * anim);
+void free_animation(animation * anim);
+void add_sphere_key(animation * anim, int frame, int sphere_index, sphere s);
+void add_light_key(animation * anim, int frame, point location);
+void sort_keys(animation * anim);
+void pose_scene(struct scene_struct * sc, int frame);
+
+#endif
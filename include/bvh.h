@@ -0,0 +1,60 @@
+/********************************
+ * Bounding volume hierarchy over the spheres of a scene.
+ *
+ * The tree is built with the surface area heuristic and stored flat in
+ * depth first order: the left child of a node directly follows it, the
+ * index of the right child is stored in the node. The spheres are copied
+ * into one array in leaf order so a leaf is a contiguous run of them,
+ * and their geometry into a structure of arrays in the same order for
+ * the intersection kernels.
+ ********************************/
+#ifndef BVH_H
+#define BVH_H
+
+#include "geometry.h"
+#include "intersect.h"
+#include "stats.h"
+
+struct sphere_list_struct;
+
+typedef struct bvh_node_struct {
+    point min, max;
+    int first;      /*leaf: first sphere, inner node: right child*/
+    int count;      /*spheres in a leaf, 0 for inner nodes*/
+} bvh_node;
+
+typedef struct bvh_struct {
+    bvh_node * nodes;
+    int node_count;
+    struct sphere_list_struct * prims;
+    int prim_count;
+    sphere_soa soa;
+    /*the index in the list the tree was built from of the sphere at each
+     * leaf position, for refit_bvh; NULL in a mapped scene*/
+    int * order;
+    /*the surface area cost of the tree as built, refit_bvh compares the
+     * cost of the refit tree with it*/
+    double built_cost;
+} bvh;
+
+/*refit_bvh builds the tree again once refitting has made it this much
+ * costlier than it was built*/
+#define REBUILD_GROWTH 1.3
+
+void build_bvh(bvh * tree, const struct sphere_list_struct * spheres, int count);
+bool refit_bvh(bvh * tree, const struct sphere_list_struct * spheres);
+void free_bvh(bvh * tree);
+bool check_bvh(const bvh * tree);
+
+bool bvh_closest(const bvh * tree, ray r, hit_record * hit, ray_stats * stats);
+bool linear_closest(const bvh * tree, ray r, hit_record * hit, ray_stats * stats);
+int bvh_any_hit(const bvh * tree, ray r, int hint, ray_stats * stats);
+int linear_any_hit(const bvh * tree, ray r, ray_stats * stats);
+
+/*most rays bvh_closest_packet takes at once*/
+#define MAX_PACKET 64
+
+void bvh_closest_packet(const bvh * tree, const ray * rays, int n, hit_record * hits,
+        ray_stats * stats);
+
+#endif
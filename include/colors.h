@@ -31,11 +31,11 @@ typedef struct color_struct {
 	float r, g, b, a;
 } color; 
 
-color multiply_colors(color one, color two);
-color add_colors(color one, color two);
-color scale_color(double scale, color one);
+static inline color multiply_colors(color one, color two);
+static inline color add_colors(color one, color two);
+static inline color scale_color(double scale, color one);
 
-color multiply_colors(color one, color two){
+static inline color multiply_colors(color one, color two){
     color result;
     result.r = one.r * two.r;
     result.g = one.g * two.g;
@@ -45,7 +45,7 @@ color multiply_colors(color one, color two){
 }
 
 /*add two colors together (clamps colors at 0)*/
-color add_colors(color one, color two){
+static inline color add_colors(color one, color two){
     color result;
     result.r = fmax(0, one.r) + fmax(0, two.r);
     result.g = fmax(0, one.g) + fmax(0, two.g);
@@ -55,7 +55,7 @@ color add_colors(color one, color two){
 }
 
 
-color scale_color(double scale, color one){
+static inline color scale_color(double scale, color one){
     color result;
     result.r = one.r * scale;
     result.g = one.g * scale;
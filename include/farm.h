@@ -0,0 +1,28 @@
+/********************************
+ * One frame traced by many processes. A farm hands the frame out a few
+ * rows of tiles at a time to workers, on this machine or others, over a
+ * Unix domain or TCP socket, and gathers what they trace into its
+ * canvas.
+ *
+ * An address is unix:PATH or HOST:PORT; a farm may leave HOST out to
+ * listen on every interface. Workers connect to the farm, which sends
+ * each the render settings and the scene file once, then jobs of tile
+ * rows. When a worker goes away, or has not answered a job within the
+ * farm timeout, its rows are handed to the others; the first answer for
+ * a row is the one kept. Tiles are seeded by their place in the frame,
+ * so the image is the one a single process renders. Farm and workers
+ * must share byte order and precision, which the farm checks, and a
+ * binary scene file needs the same build everywhere.
+ ********************************/
+#ifndef FARM_H
+#define FARM_H
+
+#include <stdbool.h>
+
+#include "options.h"
+#include "render.h"
+
+bool farm_frame(renderer * rd, const render_options * opts);
+int run_worker(const render_options * opts);
+
+#endif
@@ -0,0 +1,65 @@
+/********************************
+ * A cache of every sphere hit of a render, so a change to the light can
+ * be shaded again without casting any rays.
+ *
+ * A pixel's color is the sum over the spheres its path hits of the Phong
+ * color of the hit, scaled by the path weight up to it. Nothing but the
+ * Phong colors depends on the light, so keeping the hits of each pixel
+ * (at most one per bounce) is enough to recolor it.
+ ********************************/
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "colors.h"
+#include "geometry.h"
+#include "scene.h"
+#include "stats.h"
+
+/*one bounce of a pixel's path that hit a sphere*/
+typedef struct gbuffer_hit_struct {
+    const sphere_list * sphere;
+    point p;
+    vector normal;      /*unit surface normal at p*/
+    vector view;        /*unit vector from p back along the ray*/
+    double weight;      /*share of the pixel this hit's color makes up*/
+} gbuffer_hit;
+
+typedef struct gbuffer_struct {
+    gbuffer_hit * hits;     /*depth slots per pixel*/
+    int * count;            /*slots used by each pixel*/
+    int pixels, depth;
+    /*every pixel has been traced since the geometry last changed*/
+    bool valid;
+} gbuffer;
+
+bool init_gbuffer(gbuffer * gb, int pixels, int depth);
+void free_gbuffer(gbuffer * gb);
+void shade_gbuffer(const gbuffer * gb, const scene * sc, int first, int last,
+        color * canvas, ray_stats * stats);
+
+/*forgets the hits of pixel before it is traced again*/
+static inline void gbuffer_clear(gbuffer * gb, int pixel){
+    if(gb != NULL){
+        gb->count[pixel] = 0;
+    }
+}
+
+/*adds a hit to the path of pixel*/
+static inline void gbuffer_record(gbuffer * gb, int pixel, const sphere_list * sl,
+        point p, vector normal, vector view, double weight){
+    gbuffer_hit * h;
+    if(gb == NULL || gb->count[pixel] >= gb->depth){
+        return;
+    }
+    h = &gb->hits[(size_t)pixel*gb->depth + gb->count[pixel]++];
+    h->sphere = sl;
+    h->p = p;
+    h->normal = normal;
+    h->view = view;
+    h->weight = weight;
+}
+
+#endif
@@ -0,0 +1,11 @@
+/********************************
+ * Renders the scene straight to an image file without OpenGL.
+ ********************************/
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "options.h"
+
+int run_headless(const render_options * opts);
+
+#endif
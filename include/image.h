@@ -0,0 +1,36 @@
+/********************************
+ * Writes a traced buffer of colors out to an image file, or packs it
+ * into bytes for display, and reads written images back to compare them.
+ * Buffers are stored bottom row first (as OpenGL draws them) with rows
+ * stride colors apart, files are written top row first.
+ ********************************/
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "colors.h"
+
+/*an image file being written, top row first*/
+typedef struct image_writer_struct {
+    FILE * f;
+    bool png;
+    int width, height;
+    int rows;                   /*rows written so far*/
+    unsigned char * row;        /*one packed row (after the PNG filter byte)*/
+    uint32_t crc;               /*of the PNG chunk being written*/
+    uint32_t adler_a, adler_b;  /*checksum of the zlib stream*/
+} image_writer;
+
+bool open_image(image_writer * w, const char * path, int width, int height);
+/*rows points at the bottom one of count rows stride colors apart*/
+bool write_rows(image_writer * w, const color * rows, int count, int stride);
+bool close_image(image_writer * w);
+bool write_image(const char * path, const color * pixels, int width, int height,
+        int stride);
+unsigned char * read_ppm(const char * path, int * width, int * height);
+void pack_rgba(unsigned char * out, const color * pixels, int count);
+
+#endif
@@ -0,0 +1,52 @@
+/********************************
+ * Ray against many spheres at once.
+ *
+ * The spheres are kept as a structure of arrays so a vector unit can
+ * test several of them with each instruction. The kernel is picked when
+ * the program starts from what the cpu supports: AVX2 tests four spheres
+ * at a time, SSE2 two (twice that in a float build), and the scalar
+ * version runs anywhere.
+ ********************************/
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
+#include "geometry.h"
+
+/*room past the last sphere so vector loads of the final group stay in
+ * bounds, an AVX2 register holds four doubles or eight floats*/
+#ifdef RAYFOO_FLOAT
+#define SOA_PADDING 8
+#else
+#define SOA_PADDING 4
+#endif
+
+/*the closest hit of a ray: how far along it (in units of the ray's
+ * at - orgin) and the index of the sphere in the structure of arrays, -1
+ * for a miss. The point and the normal are only worked out for the hit
+ * that is shaded, not for every closer sphere found on the way*/
+typedef struct hit_record_struct {
+    real t;
+    int index;
+} hit_record;
+
+typedef struct sphere_soa_struct {
+    real * cx, * cy, * cz;
+    real * r2;          /*radius squared*/
+    int * material;     /*index of the sphere's shading record*/
+    int count;
+} sphere_soa;
+
+/*finds the nearest sphere in [first, first + count) hit by r closer than
+ * *t (in units of the ray's at - orgin), updates *t and returns its index,
+ * or returns -1 and leaves *t alone if there is none*/
+typedef int (*nearest_sphere_fn)(const sphere_soa * s, int first, int count, ray r, real * t);
+
+extern nearest_sphere_fn nearest_sphere;
+
+void alloc_sphere_soa(sphere_soa * s, int count);
+void free_sphere_soa(sphere_soa * s);
+void set_soa_sphere(sphere_soa * s, int i, sphere sph, int material);
+
+const char * select_kernel(const char * name);
+
+#endif
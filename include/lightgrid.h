@@ -0,0 +1,60 @@
+/********************************
+ * Uniform grid over the point lights of a scene, so shading a hit only
+ * looks at the lights that can reach it.
+ *
+ * Each light reaches a sphere of its radius. The grid covers the boxes
+ * of those spheres and every cell lists the lights whose sphere overlaps
+ * it, stored flat: the lights of cell c are lights[first[c]] up to
+ * lights[first[c + 1]].
+ ********************************/
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include <stddef.h>
+
+#include "geometry.h"
+
+struct point_light_struct;
+
+/*cells a grid aims for per light, and its most cells along an axis*/
+#define GRID_CELLS_PER_LIGHT 4
+#define GRID_MAX_DIM 64
+/*least extent of the grid along an axis, so a light whose reach vanishes
+ * against its coordinates still gives finite cells*/
+#define GRID_MIN_EXTENT 1e-6
+
+typedef struct light_grid_struct {
+    point min;
+    vector inv_cell;    /*cells per unit along each axis*/
+    int nx, ny, nz;
+    int * first;        /*nx * ny * nz + 1 entries*/
+    int * lights;
+    int entries;        /*length of lights*/
+} light_grid;
+
+void build_light_grid(light_grid * grid, const struct point_light_struct * lights,
+        int count);
+void free_light_grid(light_grid * grid);
+
+/*the lights that may reach p, count of them in *count*/
+static inline const int * grid_lights(const light_grid * grid, point p, int * count){
+    double x, y, z;
+    int c;
+    *count = 0;
+    if(grid->first == NULL || p.x < grid->min.x || p.y < grid->min.y || p.z < grid->min.z){
+        return NULL;
+    }
+    x = (p.x - grid->min.x) * grid->inv_cell.x;
+    y = (p.y - grid->min.y) * grid->inv_cell.y;
+    z = (p.z - grid->min.z) * grid->inv_cell.z;
+    /*bounded before the conversion, which is undefined for hits far
+     * outside the grid (and fails for NaN too)*/
+    if(!(x < grid->nx && y < grid->ny && z < grid->nz)){
+        return NULL;
+    }
+    c = ((int)z * grid->ny + (int)y) * grid->nx + (int)x;
+    *count = grid->first[c + 1] - grid->first[c];
+    return grid->lights + grid->first[c];
+}
+
+#endif
@@ -0,0 +1,20 @@
+/********************************
+ * Unix domain and TCP sockets for the render farm and server. An address
+ * is unix:PATH or HOST:PORT, and a listener may leave HOST out to listen
+ * on every interface.
+ ********************************/
+#ifndef NET_H
+#define NET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*connections a listener lets wait to be accepted*/
+#define LISTEN_BACKLOG 256
+
+int open_address(const char * address, bool listening);
+void close_address(int fd, const char * address);
+bool read_all(int fd, void * data, size_t size);
+bool write_all(int fd, const void * data, size_t size);
+
+#endif
@@ -0,0 +1,64 @@
+/********************************
+ * Command line options shared by the viewer and the headless renderer.
+ ********************************/
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+
+#define DEFAULT_WIDTH 300
+#define DEFAULT_HEIGHT 300
+/*largest image, so pixel indices (and 16K x 16K) fit an int*/
+#define MAX_PIXELS (16384 * 16384)
+/*largest tile edge, the largest image's, so a tile's pixels fit an int
+ * and the wavefront queues' indices*/
+#define MAX_TILE 16384
+/*most bounces of a ray, which bounds the recursion of every trace*/
+#define MAX_DEPTH 64
+/*most samples per pixel anti-aliasing may take, 8x8*/
+#define MAX_AA 64
+/*seconds a farm waits for a worker's job before handing it to another*/
+#define DEFAULT_FARM_TIMEOUT 30
+/*most quads across or up a spline patch of the viewer's side panels*/
+#define MAX_SPLINE_GRID 1024
+
+typedef struct render_options_struct {
+    bool headless;
+    const char * output;    /*image file written in headless mode*/
+    bool stream;            /*headless: write bands as they are traced, no canvas*/
+    const char * scene_file;    /*scene to load, NULL for the built in one*/
+    int width, height;      /*size of the image in pixels*/
+    /*size of the camera rectangle, 0 keeps the scene's own (widened or
+     * narrowed to the image's shape)*/
+    double extent_width, extent_height;
+    int threads;            /*render threads, 0 for one per cpu*/
+    bool use_bvh;           /*false tests every sphere for every ray*/
+    bool shadows;           /*spheres block the light*/
+    bool occluder_cache;    /*shadow rays try the last blocker first*/
+    bool use_light_grid;    /*false tries every point light at every hit*/
+    const char * kernel;    /*intersection kernel, NULL picks by cpu*/
+    int tile_size;          /*edge of the tiles handed to threads, 0 for the default*/
+    int packet_size;        /*edge of the primary ray packets, 1 for single rays*/
+    bool wavefront;         /*trace breadth first instead of recursing*/
+    int max_depth;          /*most bounces of a path*/
+    double min_weight;      /*lightest path weight still traced*/
+    bool roulette;          /*Russian roulette below min_weight*/
+    int aa;                 /*most samples of an edge pixel, 1 for one per pixel*/
+    bool hit_cache;         /*keep every hit so light changes only re-shade*/
+    bool stats;             /*print counters and phase times at exit*/
+    bool stats_json;        /*as JSON rather than text*/
+    int spline_u, spline_v; /*viewer: quads across and up each side patch*/
+    const char * serve;     /*address to take render requests on*/
+    const char * farm;      /*headless: address to hand the tiles out on*/
+    const char * worker;    /*address of a farm to trace tiles for*/
+    double farm_timeout;    /*seconds before a worker's job goes to another*/
+    /*a worker goes away (drop) or stops answering (stall) when handed
+     * this job, 0 for never; for trying a farm's recovery*/
+    int drop_after, stall_after;
+} render_options;
+
+void default_options(render_options * opts);
+bool parse_options(int argc, char ** argv, render_options * opts, bool allow_unknown);
+void print_usage(const char * program);
+
+#endif
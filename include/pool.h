@@ -0,0 +1,22 @@
+/********************************
+ * A fixed set of worker threads that split a job of numbered tiles
+ * between them. Every worker starts with an equal contiguous run of
+ * tiles and steals half of another worker's remaining run once its own
+ * is empty, so expensive tiles do not leave the other threads idle.
+ ********************************/
+#ifndef POOL_H
+#define POOL_H
+
+/*called once for every tile, worker is in [0, pool_threads)*/
+typedef void (*tile_job)(void * arg, int tile, int worker);
+
+typedef struct render_pool_struct render_pool;
+
+render_pool * create_pool(int threads);
+void destroy_pool(render_pool * pool);
+int pool_threads(const render_pool * pool);
+void pool_run(render_pool * pool, int tiles, tile_job job, void * arg);
+
+int online_cpus();
+
+#endif
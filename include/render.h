@@ -0,0 +1,105 @@
+/********************************
+ * Turns a scene into pixels: splits the canvas into square tiles and
+ * traces them on the worker threads of a render_pool.
+ ********************************/
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "colors.h"
+#include "image.h"
+#include "options.h"
+#include "pool.h"
+#include "scene.h"
+#include "stats.h"
+#include "wavefront.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define DEFAULT_TILE_SIZE 16
+/*block edge of the first, coarsest pass of a progressive render, each
+ * following pass halves it down to single pixels*/
+#define PROGRESSIVE_START 8
+/*a pixel is anti-aliased when a neighbour hit another sphere first or
+ * differs by more than this in some channel, and so is a subdivided
+ * sample whose quarters do*/
+#define AA_CONTRAST 0.05f
+
+/*how many colors fill a cache line*/
+#define COLORS_PER_LINE (64 / (int)sizeof(color))
+
+/*the traced colors, row 0 is the bottom row. Rows are stride pixels
+ * apart, padded to whole cache lines, so rows and 16 pixel wide tiles
+ * both start on a line and threads working on neighbouring tiles never
+ * share one*/
+typedef struct framebuffer_struct {
+    color * pixels;
+    int width, height;
+    int stride;
+} framebuffer;
+
+/*how rays are followed through their reflections*/
+typedef enum {
+    ENGINE_RECURSIVE,   /*cast_ray, depth first, one pixel at a time*/
+    ENGINE_WAVEFRONT    /*trace_wavefront, a tile's rays bounce by bounce*/
+} render_engine;
+
+/*the counts of one worker thread, alone on its cache line*/
+typedef struct worker_stats_struct {
+    _Alignas(64) ray_stats s;
+} worker_stats;
+
+/*how a frame is rendered, shared by every compute_scene call*/
+typedef struct renderer_struct {
+    render_pool * pool;
+    /*allocated by init_renderer at the requested size, and again by
+     * resize_renderer, only sized (pixels NULL) for a streamed render or
+     * a farm worker*/
+    framebuffer canvas;
+    int tile_size;
+    int packet_size;
+    render_engine engine;
+    /*one per worker thread, for the wavefront engine*/
+    wavefront * waves;
+    /*hits of the last render, NULL unless opts->hit_cache*/
+    struct gbuffer_struct * hits;
+    /*levels of 2x2 subdivision edge pixels may get, 0 for none*/
+    int aa_levels;
+    /*the sphere each pixel's primary ray hit first and the pixels the
+     * anti-aliasing pass refines, NULL unless aa_levels > 0*/
+    const sphere_list ** first_hits;
+    unsigned char * refine;
+    /*set from another thread to stop the render in flight*/
+    atomic_bool cancel;
+    /*tiles finished out of tiles_total, over all passes of the render*/
+    atomic_int tiles_done;
+    atomic_int tiles_total;
+    /*rows of canvas written since take_dirty_rows last ran, the first in
+     * the low half and one past the last in the high half*/
+    _Atomic uint64_t dirty_rows;
+    /*one per worker thread, summed by render_stats*/
+    worker_stats * stats;
+    /*time spent in each phase, callers add the phases outside render.c*/
+    phase_times times;
+} renderer;
+
+void init_renderer(renderer * rd, const render_options * opts);
+void destroy_renderer(renderer * rd);
+void resize_renderer(renderer * rd, int width, int height);
+void configure_scene(scene * sc, const render_options * opts);
+
+void compute_scene(renderer * rd, const scene * sc);
+void trace_band(renderer * rd, const scene * sc, int first, int count, color * band);
+bool compute_scene_progressive(renderer * rd, const scene * sc);
+bool stream_scene(renderer * rd, const scene * sc, image_writer * out);
+void cancel_render(renderer * rd);
+double render_progress(renderer * rd);
+bool reshade_scene(renderer * rd, const scene * sc);
+bool take_dirty_rows(renderer * rd, int * first, int * last);
+void render_stats(const renderer * rd, ray_stats * total);
+void reset_render_stats(renderer * rd);
+void print_render_stats(FILE * out, const renderer * rd, bool json);
+
+#endif
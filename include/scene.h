@@ -0,0 +1,166 @@
+/********************************
+ * The ray traced scene: the spheres and the lights. Nothing in here
+ * depends on OpenGL so it can be linked into the headless renderer as
+ * well as the viewer.
+ ********************************/
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "animation.h"
+#include "bvh.h"
+#include "colors.h"
+#include "geometry.h"
+#include "lightgrid.h"
+
+/*extent of the default camera and of random_scene*/
+#define SCENE_WIDTH 200
+#define SCENE_HEIGHT 200
+
+/*reflections weighing less than half an 8 bit step are not cast*/
+#define DEFAULT_MIN_WEIGHT (0.5 / 255)
+
+/*highest specular exponent shaded by multiplying instead of pow*/
+#define MAX_WHOLE_EXPONENT 64
+
+/*how a sphere's material is shaded, chosen once when it is added*/
+typedef enum {
+    SHADE_PHONG,        /*any exponent, raised with pow*/
+    SHADE_PHONG_WHOLE,  /*a whole exponent up to MAX_WHOLE_EXPONENT*/
+    SHADE_DIFFUSE,      /*no specular color, so no highlight to work out*/
+    SHADE_COUNT
+} shading;
+
+/*a sphere of the scene's sphere list and its properties*/
+typedef struct sphere_list_struct {
+    sphere s;
+    color ambient, diffuse, specular;
+    double s_exp, reflectivity;
+    shading shade;      /*set by append_sphere from the properties above*/
+} sphere_list;
+
+
+/*represents a light by location and coloration*/
+typedef struct light_struct {
+    point location;
+    color ambient, diffuse, specular;
+} light;
+
+
+/*a light of limited reach besides light0: its diffuse and specular light
+ * fade smoothly to nothing at radius from it, l.ambient is unused*/
+typedef struct point_light_struct {
+    light l;
+    double radius;
+} point_light;
+
+
+/*the parallel view volume: the rectangle of the z = 0 plane the image
+ * covers, rays leave it toward -z*/
+typedef struct camera_struct {
+    double x1, y1, x2, y2;
+} camera;
+
+
+/*everything the tracer reads, passed explicitly so cast_ray can run on
+ * many threads at once; it is never written while a render is running*/
+typedef struct scene_struct {
+    /*the main light for the scene, reaching everywhere*/
+    light light0;
+    /*lights of limited reach, and the grid over them made by build_scene;
+     * use_light_grid false tries every light at every hit instead*/
+    point_light * lights;
+    int light_count, light_capacity;
+    light_grid grid;
+    bool use_light_grid;
+    /*list of spheres in the scene, one array*/
+    sphere_list * list;
+    int sphere_count, sphere_capacity;
+    camera view;
+    /*reflections are followed while their path weight is at least
+     * min_weight (or, with roulette, randomly below it), never past
+     * max_ray_depth*/
+    int max_ray_depth;
+    double min_weight;
+    bool roulette;
+    double floor;
+    /*the spheres of list in one array with a tree over them, made by
+     * build_scene; use_bvh false tests every sphere instead*/
+    bvh accel;
+    bool use_bvh;
+    /*spheres block the light, tested with an any-hit query from each
+     * hit; occluder_cache tries the last blocker found first*/
+    bool shadows;
+    bool occluder_cache;
+    /*keyframes of the spheres and light0, pose_scene moves them to a
+     * frame; mapped scenes have none*/
+    animation anim;
+    /*set when list and accel point into a mapped scene file*/
+    void * mapping;
+    size_t mapping_size;
+} scene;
+
+
+color phong_sphere(point sphere_center, point p, point viewer, color ambient, color diffuse,
+                    color specular, double specular_exp, light lght);
+color phong_hit(const sphere_list * sl, point p, vector n, vector v, light lght);
+
+struct gbuffer_struct;
+
+/*the state of one thread tracing a scene*/
+typedef struct tracer_struct {
+    const scene * sc;
+    /*seeds Russian roulette, which draws from it by pixel and depth*/
+    unsigned long long rng;
+    /*when set, the hits of the pixel being traced are recorded in it*/
+    struct gbuffer_struct * cache;
+    /*when set, the sphere the primary ray of the pixel being traced hits
+     * first (NULL for none) is recorded in it*/
+    const sphere_list ** first_hit;
+    int pixel;
+    /*index in the whole frame of pixel 0 of the canvas or band traced, so
+     * a pixel's roulette draws do not depend on the band it is in*/
+    size_t first_pixel;
+    /*the sphere (index into the scene's accel.soa) that blocked the last
+     * shadow ray, -1 for none*/
+    int last_occluder;
+    ray_stats stats;
+} tracer;
+
+
+/*the shading record of the sphere hit names*/
+static inline const sphere_list * hit_sphere(const scene * sc, const hit_record * hit){
+    return &sc->accel.prims[sc->accel.soa.material[hit->index]];
+}
+
+/*the unit normal at p, the point of hit on its sphere*/
+static inline vector hit_normal(const scene * sc, const hit_record * hit, point p){
+    const sphere_soa * s = &sc->accel.soa;
+    vector n = {p.x - s->cx[hit->index], p.y - s->cy[hit->index],
+                p.z - s->cz[hit->index]};
+    return normalize_vector(n);
+}
+
+void init_tracer(tracer * tr, const scene * sc, unsigned long long seed);
+double tracer_random(tracer * tr);
+double continue_path(const tracer * tr, double weight, int pixel, int depth);
+
+bool closest_sphere(tracer * tr, ray r, hit_record * hit);
+color light_hit(tracer * tr, const sphere_list * sl, point p, vector n, vector v);
+color cast_ray(tracer * tr, ray r, int depth, double weight);
+void cast_packet(tracer * tr, const ray * rays, const int * pixels, int n, color * out);
+
+void init_scene(scene * sc);
+void add_sphere(scene * sc, double x, double y, double z, double r, color c,
+        double reflectivity, double spec_exp);
+void append_sphere(scene * sc, const sphere_list * sl);
+void add_light(scene * sc, const point_light * pl);
+void setup_scene(scene * sc);
+void random_scene(scene * sc, int count, unsigned long long seed);
+void random_lights(scene * sc, int count, unsigned long long seed);
+void build_scene(scene * sc);
+void free_scene(scene * sc);
+
+#endif
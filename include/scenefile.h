@@ -0,0 +1,46 @@
+/********************************
+ * Scenes stored in files, as text to write by hand or as a binary image
+ * of the built scene to map straight into memory.
+ *
+ * The text format is one item per line, # starts a comment:
+ *
+ *      camera X1 Y1 X2 Y2      the rectangle of z = 0 the image covers
+ *      floor Y                 height of the mirror floor
+ *      light X Y Z  AR AG AB  DR DG DB  SR SG SB
+ *      point_light X Y Z  DR DG DB  SR SG SB  RADIUS
+ *      material NAME  AR AG AB  DR DG DB  SR SG SB  REFLECTIVITY EXPONENT
+ *      sphere X Y Z RADIUS NAME
+ *      sphere X Y Z RADIUS R G B REFLECTIVITY EXPONENT
+ *      frames COUNT            makes the scene a sequence of frames
+ *      key FRAME sphere INDEX X Y Z RADIUS
+ *      key FRAME light X Y Z
+ *
+ * where A, D and S are the ambient, diffuse and specular colors and the
+ * short sphere form uses one color for all three, like add_sphere. There
+ * is one light, lighting everything, and any number of point lights
+ * whose light fades out at their radius. Keys place a sphere (counted
+ * from 0 in the order of the sphere lines above) or the light at a frame
+ * from 0 to COUNT - 1, see animation.h; frames comes before them.
+ * Anything left out keeps the value init_scene gives it: the default
+ * camera and floor and a black light.
+ *
+ * The binary format is a versioned header followed by the spheres in
+ * leaf order, the tree, the intersection arrays, the point lights and
+ * their grid, each 64 byte aligned, exactly as build_scene lays them out
+ * in memory. Loading it maps the file and points the scene at it, no
+ * parsing, copying or tree building. It is only read by builds with the writer's byte order,
+ * precision and struct layout, which the header records. It holds no
+ * keys, animated scenes stay in the text format.
+ ********************************/
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <stdbool.h>
+
+#include "scene.h"
+
+bool load_scene(scene * sc, const char * path);
+bool save_scene_text(const scene * sc, const char * path);
+bool save_scene_binary(const scene * sc, const char * path);
+
+#endif
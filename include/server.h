@@ -0,0 +1,31 @@
+/********************************
+ * A long running renderer that answers requests on a socket, keeping the
+ * scenes it has loaded, with their trees and light grids, and its thread
+ * pool from one request to the next.
+ *
+ * Requests are lines of text, one reply line each starting with ok or
+ * error (stats sends its lines before that one):
+ *
+ *   load NAME FILE|builtin     load (or reload) a scene and build it
+ *   unload NAME
+ *   render NAME OUTPUT [size WxH] [extent WxH] [center X Y]
+ *          [light X Y Z] [depth N] [frame N]
+ *   stats [json]               requests served and the tracing counters
+ *   quit                       close this connection
+ *   shutdown                   stop the server
+ *
+ * Requests name files to read and write and nothing checks who sends
+ * them, so the server listens on a Unix domain socket only, whose file's
+ * permissions decide who may connect. Every render starts from the
+ * scene's camera and light as loaded. The requests of all connections
+ * are queued in the order they came and served one at a time, each with
+ * every thread of the pool.
+ ********************************/
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "options.h"
+
+int run_server(const render_options * opts);
+
+#endif
@@ -0,0 +1,96 @@
+/********************************
+ * Counts of the work done tracing, and wall clock time per phase.
+ *
+ * Each tracer counts into its own ray_stats, which the renderer adds to
+ * its worker's total after every tile, so counting needs no atomics.
+ * The counting itself is wrapped in STAT() and compiles to nothing
+ * unless RAYFOO_STATS is defined (make STATS=0 leaves it out).
+ ********************************/
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef RAYFOO_STATS
+#define STAT(expr) (expr)
+#else
+#define STAT(expr) ((void)0)
+#endif
+
+/*rays are counted by depth up to here, deeper ones in the last slot*/
+#define STATS_DEPTHS 16
+
+typedef struct ray_stats_struct {
+    unsigned long long rays;            /*closest hit queries, primary and reflected*/
+    unsigned long long rays_by_depth[STATS_DEPTHS];     /*0 for primary rays*/
+    unsigned long long box_tests;       /*ray (or packet) against bvh node*/
+    unsigned long long sphere_tests;    /*ray against sphere*/
+    unsigned long long sphere_hits;     /*queries that found a sphere*/
+    unsigned long long floor_hits;      /*rays reflected by the floor*/
+    unsigned long long phong_evals;
+    unsigned long long shadow_rays;     /*any-hit queries toward a light*/
+    unsigned long long shadowed;        /*hits left with ambient light only*/
+    unsigned long long occluder_hits;   /*shadow rays blocked by the last blocker*/
+    unsigned long long light_tests;     /*point lights looked at for a hit*/
+    unsigned long long light_evals;     /*point lights that lit one*/
+    unsigned long long depth_cap;       /*reflections cut by max_ray_depth*/
+    unsigned long long weight_cut;      /*reflections too light to cast*/
+    /*primary rays cast to anti-alias edges, on top of one per pixel.
+     * Counted even without RAYFOO_STATS, it is one add per pixel refined*/
+    unsigned long long aa_rays;
+} ray_stats;
+
+/*the parts of a run that are timed*/
+typedef enum {
+    PHASE_SETUP,        /*building the scene*/
+    PHASE_RENDER,       /*compute_scene and its progressive form*/
+    PHASE_RESHADE,      /*reshade_scene*/
+    PHASE_DISPLAY,      /*the viewer's display_func*/
+    PHASE_POSE,         /*pose_scene between the frames of a sequence*/
+    PHASE_COUNT
+} phase;
+
+typedef struct phase_times_struct {
+    double seconds[PHASE_COUNT];
+    unsigned long calls[PHASE_COUNT];
+} phase_times;
+
+static inline void add_stats(ray_stats * into, const ray_stats * s){
+    int i;
+    into->rays += s->rays;
+    for(i = 0; i < STATS_DEPTHS; ++i){
+        into->rays_by_depth[i] += s->rays_by_depth[i];
+    }
+    into->box_tests += s->box_tests;
+    into->sphere_tests += s->sphere_tests;
+    into->sphere_hits += s->sphere_hits;
+    into->floor_hits += s->floor_hits;
+    into->phong_evals += s->phong_evals;
+    into->shadow_rays += s->shadow_rays;
+    into->shadowed += s->shadowed;
+    into->occluder_hits += s->occluder_hits;
+    into->light_tests += s->light_tests;
+    into->light_evals += s->light_evals;
+    into->depth_cap += s->depth_cap;
+    into->weight_cut += s->weight_cut;
+    into->aa_rays += s->aa_rays;
+}
+
+/*the slot of rays_by_depth a ray at depth counts in*/
+static inline int stats_depth(unsigned int depth){
+    return depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1;
+}
+
+/*starts timing a phase*/
+static inline struct timespec phase_start(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+void phase_end(phase_times * times, phase ph, struct timespec start);
+void print_stats(FILE * out, const ray_stats * st, const phase_times * times, bool json);
+
+#endif
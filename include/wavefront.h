@@ -0,0 +1,37 @@
+/********************************
+ * Breadth first ray tracing.
+ *
+ * Instead of following each ray's reflections down to the depth limit
+ * before starting the next ray, a wavefront holds every ray of one bounce
+ * in a queue: the whole queue is intersected, then shaded, and the
+ * reflections it spawns form the queue of the next bounce, sorted so
+ * rays going the same way from nearby points are traced together.
+ ********************************/
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <stdint.h>
+
+#include "colors.h"
+#include "scene.h"
+
+/*a queued ray and what it adds to its pixel*/
+typedef struct wave_ray_struct {
+    ray r;
+    double weight;      /*product of the reflectivities along the path*/
+    int pixel;          /*index into the canvas*/
+} wave_ray;
+
+/*the queues and per ray results of one thread's wavefront*/
+typedef struct wavefront_struct {
+    wave_ray * current, * next;
+    hit_record * hit;
+    uint64_t * keys;    /*sort key in the high bits, queue index in the low*/
+    size_t capacity;
+} wavefront;
+
+void init_wavefront(wavefront * wf, size_t capacity);
+void free_wavefront(wavefront * wf);
+void trace_wavefront(wavefront * wf, tracer * tr, int n, color * canvas);
+
+#endif
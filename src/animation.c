@@ -0,0 +1,143 @@
+/*********************
+ * Keyframes and posing a scene for a frame of its sequence.
+ *
+ * add_sphere_key - keys a sphere's center and radius at a frame
+ * add_light_key - keys light0's location at a frame
+ * sort_keys - orders the keys for pose_scene, build_scene calls it
+ * pose_scene - moves the keyed spheres and light0 to a frame and refits
+ *                  the tree around the spheres
+ */
+#include "animation.h"
+#include "scene.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void init_animation(animation * anim){
+    memset(anim, 0, sizeof(animation));
+}
+
+void free_animation(animation * anim){
+    free(anim->sphere_keys);
+    free(anim->light_keys);
+    init_animation(anim);
+}
+
+/*keys sphere_index of the scene's list to be s at frame*/
+void add_sphere_key(animation * anim, int frame, int sphere_index, sphere s){
+    sphere_key * k;
+    if(anim->sphere_key_count == anim->sphere_key_capacity){
+        anim->sphere_key_capacity = anim->sphere_key_capacity > 0
+            ? 2 * anim->sphere_key_capacity : 16;
+        anim->sphere_keys = realloc(anim->sphere_keys,
+                sizeof(sphere_key) * anim->sphere_key_capacity);
+    }
+    k = &anim->sphere_keys[anim->sphere_key_count++];
+    k->frame = frame;
+    k->sphere = sphere_index;
+    k->s = s;
+}
+
+/*keys light0 to be at location at frame*/
+void add_light_key(animation * anim, int frame, point location){
+    light_key * k;
+    if(anim->light_key_count == anim->light_key_capacity){
+        anim->light_key_capacity = anim->light_key_capacity > 0
+            ? 2 * anim->light_key_capacity : 16;
+        anim->light_keys = realloc(anim->light_keys,
+                sizeof(light_key) * anim->light_key_capacity);
+    }
+    k = &anim->light_keys[anim->light_key_count++];
+    k->frame = frame;
+    k->location = location;
+}
+
+static int compare_sphere_keys(const void * a, const void * b){
+    const sphere_key * ka = a, * kb = b;
+    if(ka->sphere != kb->sphere){
+        return ka->sphere < kb->sphere ? -1 : 1;
+    }
+    return (ka->frame > kb->frame) - (ka->frame < kb->frame);
+}
+
+static int compare_light_keys(const void * a, const void * b){
+    const light_key * ka = a, * kb = b;
+    return (ka->frame > kb->frame) - (ka->frame < kb->frame);
+}
+
+/*sorts the sphere keys by sphere and frame and the light keys by frame.
+ * A scene without keys has no arrays, which qsort may not be given*/
+void sort_keys(animation * anim){
+    if(anim->sphere_key_count > 0){
+        qsort(anim->sphere_keys, anim->sphere_key_count, sizeof(sphere_key),
+                compare_sphere_keys);
+    }
+    if(anim->light_key_count > 0){
+        qsort(anim->light_keys, anim->light_key_count, sizeof(light_key),
+                compare_light_keys);
+    }
+}
+
+static point lerp_point(point a, point b, double t){
+    point p;
+    p.x = a.x + t * (b.x - a.x);
+    p.y = a.y + t * (b.y - a.y);
+    p.z = a.z + t * (b.z - a.z);
+    return p;
+}
+
+/*where the count keys of one sphere, sorted by frame, put it at frame*/
+static sphere sphere_at(const sphere_key * keys, int count, int frame){
+    sphere s;
+    double t;
+    int i = 0;
+    while(i + 1 < count && keys[i + 1].frame <= frame){
+        ++i;
+    }
+    if(i + 1 == count || frame <= keys[i].frame){
+        return keys[i].s;
+    }
+    t = (frame - keys[i].frame) / (double)(keys[i + 1].frame - keys[i].frame);
+    s.center = lerp_point(keys[i].s.center, keys[i + 1].s.center, t);
+    s.radius = keys[i].s.radius + t * (keys[i + 1].s.radius - keys[i].s.radius);
+    return s;
+}
+
+/*where the count light keys, sorted by frame, put light0 at frame*/
+static point light_at(const light_key * keys, int count, int frame){
+    double t;
+    int i = 0;
+    while(i + 1 < count && keys[i + 1].frame <= frame){
+        ++i;
+    }
+    if(i + 1 == count || frame <= keys[i].frame){
+        return keys[i].location;
+    }
+    t = (frame - keys[i].frame) / (double)(keys[i + 1].frame - keys[i].frame);
+    return lerp_point(keys[i].location, keys[i + 1].location, t);
+}
+
+/*moves the keyed spheres and light0 of sc, which must have been built,
+ * to where they are at frame. The tree's boxes are refit around the
+ * spheres, it is only built again when that has made it too slow*/
+void pose_scene(scene * sc, int frame){
+    const animation * anim = &sc->anim;
+    const sphere_key * keys = anim->sphere_keys;
+    int i = 0, j;
+
+    while(i < anim->sphere_key_count){
+        /*the keys of one sphere are keys[i, j)*/
+        j = i + 1;
+        while(j < anim->sphere_key_count && keys[j].sphere == keys[i].sphere){
+            ++j;
+        }
+        sc->list[keys[i].sphere].s = sphere_at(keys + i, j - i, frame);
+        i = j;
+    }
+    if(anim->light_key_count > 0){
+        sc->light0.location = light_at(anim->light_keys, anim->light_key_count, frame);
+    }
+    if(anim->sphere_key_count > 0){
+        refit_bvh(&sc->accel, sc->list);
+    }
+}
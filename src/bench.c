@@ -0,0 +1,277 @@
+/*********************
+ * Benchmark driver: renders synthetic scenes of growing size and reports
+ * how fast, one line (CSV) or object (JSON) per configuration.
+ *
+ * Every configuration is a sphere count, an image size and a reflection
+ * depth. The scene comes from random_scene with a fixed seed, so runs of
+ * different builds trace exactly the same rays. Each is rendered a few times
+ * untimed to warm the caches and the pool, then timed over several
+ * trials.
+ *
+ * bench_config - renders one configuration and prints its results
+ * parse_list - reads a comma separated list of counts
+ * parse_sizes - reads a comma separated list of image sizes
+ */
+#include "options.h"
+#include "render.h"
+#include "scene.h"
+#include "stats.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_LIST 16
+
+typedef struct bench_options_struct {
+    int spheres[MAX_LIST], sphere_count;
+    int depths[MAX_LIST], depth_count;
+    int widths[MAX_LIST], heights[MAX_LIST], size_count;
+    int warmup, trials;
+    unsigned long long seed;
+    bool json;
+} bench_options;
+
+/*seconds between two monotonic time stamps*/
+static double elapsed(struct timespec start, struct timespec end){
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*reads a comma separated list of positive numbers into list*/
+static bool parse_list(const char * text, int * list, int * count){
+    char * end;
+    *count = 0;
+    do {
+        long v = strtol(text, &end, 10);
+        if(end == text || v <= 0 || *count == MAX_LIST){
+            return false;
+        }
+        list[(*count)++] = (int)v;
+        text = end + 1;
+    } while(*end == ',');
+    return *end == '\0';
+}
+
+/*reads a comma separated list of WxH image sizes*/
+static bool parse_sizes(const char * text, int * widths, int * heights, int * count){
+    char * end;
+    *count = 0;
+    do {
+        long w = strtol(text, &end, 10), h;
+        if(end == text || *end != 'x' || w <= 0 || *count == MAX_LIST){
+            return false;
+        }
+        text = end + 1;
+        h = strtol(text, &end, 10);
+        if(end == text || h <= 0 || w * h > MAX_PIXELS){
+            return false;
+        }
+        widths[*count] = (int)w;
+        heights[(*count)++] = (int)h;
+        text = end + 1;
+    } while(*end == ',');
+    return *end == '\0';
+}
+
+static void print_bench_usage(const char * program){
+    fprintf(stderr,
+        "usage: %s [--spheres n,n,...] [--sizes WxH,...] [--depths n,n,...]\n"
+        "       [--warmup n] [--trials n] [--seed n] [--json] [render options]\n"
+        "  --spheres        scene sizes (default: 10,100,...,1000000)\n"
+        "  --sizes          image sizes (default: the --size render option)\n"
+        "  --depths         reflection depths (default: 1,5)\n"
+        "  --warmup         untimed renders per configuration (default: 1)\n"
+        "  --trials         timed renders per configuration (default: 5)\n"
+        "  --seed           seed of the synthetic scenes (default: 1)\n"
+        "  --json           print a JSON array instead of CSV\n"
+        "render options:\n", program);
+    print_usage(program);
+}
+
+/*takes the benchmark's own options out of argv, leaving the rest (and
+ * argv[0]) in rest for parse_options*/
+static bool parse_bench_options(int argc, char ** argv, bench_options * bo,
+        int * rest_count, char ** rest){
+    int i;
+    char * end;
+
+    *rest_count = 0;
+    rest[(*rest_count)++] = argv[0];
+    for(i = 1; i < argc; ++i){
+        bool has_value = i + 1 < argc;
+        if(strcmp(argv[i], "--spheres") == 0 && has_value){
+            if(!parse_list(argv[++i], bo->spheres, &bo->sphere_count)){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--sizes") == 0 && has_value){
+            if(!parse_sizes(argv[++i], bo->widths, bo->heights, &bo->size_count)){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--depths") == 0 && has_value){
+            if(!parse_list(argv[++i], bo->depths, &bo->depth_count)){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--warmup") == 0 && has_value){
+            bo->warmup = (int)strtol(argv[++i], &end, 10);
+            if(*end != '\0' || bo->warmup < 0){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--trials") == 0 && has_value){
+            bo->trials = (int)strtol(argv[++i], &end, 10);
+            if(*end != '\0' || bo->trials <= 0){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value){
+            bo->seed = strtoull(argv[++i], &end, 10);
+            if(*end != '\0'){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--json") == 0){
+            bo->json = true;
+        } else {
+            rest[(*rest_count)++] = argv[i];
+        }
+    }
+    return true;
+}
+
+/*prints value in format into out, or when the rays it needs were not
+ * counted (a build without RAYFOO_STATS) leaves it null in JSON and
+ * empty in CSV*/
+static void ray_figure(char * out, size_t size, const char * format, double value,
+        bool counted, bool json){
+    if(counted){
+        snprintf(out, size, format, value);
+    } else {
+        snprintf(out, size, "%s", json ? "null" : "");
+    }
+}
+
+/*renders the count spheres of sc (built in build seconds) at depth
+ * warmup + trials times, printing the timed trials' statistics*/
+static void bench_config(renderer * rd, scene * sc, const bench_options * bo,
+        int count, double build, int depth, bool first){
+    struct timespec start, end;
+    double t, sum = 0, sum_sq = 0, best = INFINITY, mean, stddev;
+    char rays[32], rate[32], ns[32], boxes[32], spheres[32];
+    bool counted;
+    ray_stats st;
+    int i;
+
+    sc->max_ray_depth = depth;
+
+    for(i = 0; i < bo->warmup; ++i){
+        compute_scene(rd, sc);
+    }
+    reset_render_stats(rd);
+    for(i = 0; i < bo->trials; ++i){
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        compute_scene(rd, sc);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        t = elapsed(start, end);
+        sum += t;
+        sum_sq += t * t;
+        best = fmin(best, t);
+    }
+    render_stats(rd, &st);
+
+    mean = sum / bo->trials;
+    stddev = bo->trials > 1
+        ? sqrt(fmax(0, (sum_sq - sum * mean) / (bo->trials - 1))) : 0;
+    /*the counts cover every trial, each of which traced the same rays*/
+    st.rays /= bo->trials;
+    st.box_tests /= bo->trials;
+    st.sphere_tests /= bo->trials;
+
+    counted = st.rays > 0;
+    ray_figure(rays, sizeof(rays), "%.0f", (double)st.rays, counted, bo->json);
+    ray_figure(rate, sizeof(rate), "%.0f", st.rays / mean, counted, bo->json);
+    ray_figure(ns, sizeof(ns), "%.2f", mean * 1e9 / st.rays, counted, bo->json);
+    ray_figure(boxes, sizeof(boxes), "%.3f", st.box_tests / (double)st.rays, counted,
+            bo->json);
+    ray_figure(spheres, sizeof(spheres), "%.3f", st.sphere_tests / (double)st.rays,
+            counted, bo->json);
+
+    if(bo->json){
+        printf("%s\n  {\"spheres\": %d, \"width\": %d, \"height\": %d, \"depth\": %d, "
+               "\"threads\": %d, \"trials\": %d, \"build_s\": %.6f, \"mean_s\": %.6f, "
+               "\"stddev_s\": %.6f, \"min_s\": %.6f, \"rays\": %s, "
+               "\"rays_per_s\": %s, \"ns_per_ray\": %s, "
+               "\"box_tests_per_ray\": %s, \"sphere_tests_per_ray\": %s}",
+               first ? "[" : ",", count, rd->canvas.width, rd->canvas.height, depth,
+               pool_threads(rd->pool), bo->trials, build, mean, stddev, best, rays,
+               rate, ns, boxes, spheres);
+    } else {
+        if(first){
+            printf("spheres,width,height,depth,threads,trials,build_s,mean_s,stddev_s,"
+                   "min_s,rays,rays_per_s,ns_per_ray,box_tests_per_ray,"
+                   "sphere_tests_per_ray\n");
+        }
+        printf("%d,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%s,%s,%s,%s,%s\n",
+               count, rd->canvas.width, rd->canvas.height, depth, pool_threads(rd->pool),
+               bo->trials, build, mean, stddev, best, rays, rate, ns, boxes, spheres);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char ** argv){
+    bench_options bo = {
+        {10, 100, 1000, 10000, 100000, 1000000}, 6,
+        {1, 5}, 2,
+        {0}, {0}, 0,
+        1, 5, 1, false
+    };
+    struct timespec start, end;
+    render_options opts;
+    renderer rd;
+    scene sc;
+    double build;
+    char ** rest = malloc(sizeof(char *) * (argc + 1));
+    int rest_count, s, z, d;
+    bool first = true;
+
+    default_options(&opts);
+    if(!parse_bench_options(argc, argv, &bo, &rest_count, rest)
+            || !parse_options(rest_count, rest, &opts, false)){
+        print_bench_usage(argv[0]);
+        return 2;
+    }
+    free(rest);
+
+#ifndef RAYFOO_STATS
+    fprintf(stderr, "built without RAYFOO_STATS, per ray figures are left empty\n");
+#endif
+    if(bo.size_count == 0){
+        bo.widths[0] = opts.width;
+        bo.heights[bo.size_count++] = opts.height;
+    }
+    for(s = 0; s < bo.sphere_count; ++s){
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        random_scene(&sc, bo.spheres[s], bo.seed);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        build = elapsed(start, end);
+
+        for(z = 0; z < bo.size_count; ++z){
+            /*the canvas is sized when the renderer is made*/
+            opts.width = bo.widths[z];
+            opts.height = bo.heights[z];
+            configure_scene(&sc, &opts);
+            init_renderer(&rd, &opts);
+            for(d = 0; d < bo.depth_count; ++d){
+                fprintf(stderr, "%d spheres, %dx%d, depth %d\n", bo.spheres[s],
+                        opts.width, opts.height, bo.depths[d]);
+                bench_config(&rd, &sc, &bo, bo.spheres[s], build, bo.depths[d], first);
+                first = false;
+            }
+            destroy_renderer(&rd);
+        }
+        free_scene(&sc);
+    }
+    if(bo.json && !first){
+        printf("\n]\n");
+    }
+    return 0;
+}
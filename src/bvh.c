@@ -0,0 +1,638 @@
+/*********************
+ * SAH bounding volume hierarchy over the sphere list.
+ *
+ * build_bvh - builds the tree over the spheres and copies them in leaf
+ *                  order
+ * refit_bvh - moves the copies to where the spheres now are and fits the
+ *                  boxes around them again, keeping the tree's shape
+ *                  unless that has made it too slow
+ * tree_cost - the surface area heuristic's cost of a whole tree
+ * check_bvh - whether a tree read from a file can be walked safely
+ * bvh_closest - nearest sphere hit by a ray, visiting the nearer child
+ *                  first and skipping boxes behind the closest hit so far
+ * linear_closest - the same query testing every sphere, for comparison
+ * bvh_any_hit - whether any sphere lies on a segment, stopping at the
+ *                  first one found (for shadow rays)
+ * linear_any_hit - the same testing every sphere
+ * bvh_closest_packet - closest hits of a bundle of parallel rays, walking
+ *                  the tree once for the whole bundle
+ */
+#include "bvh.h"
+#include "scene.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SAH_BINS 16
+#define MAX_LEAF_SIZE 8
+/*past this depth nodes are split at the median so the tree stays shallow*/
+#define MEDIAN_DEPTH 40
+#define STACK_SIZE 128
+
+/*an axis aligned box*/
+typedef struct bounds_struct {
+    point min, max;
+} bounds;
+
+/*the state shared by the recursive build*/
+typedef struct builder_struct {
+    bvh * tree;
+    bounds * boxes;     /*bounds of each sphere*/
+    point * centers;
+    int * order;        /*sphere index at each leaf position*/
+} builder;
+
+static double axis_of(point p, int axis){
+    return axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+}
+
+static bounds empty_bounds(){
+    bounds b;
+    b.min.x = b.min.y = b.min.z = REAL_MAX;
+    b.max.x = b.max.y = b.max.z = -REAL_MAX;
+    return b;
+}
+
+static void grow_bounds(bounds * b, bounds other){
+    b->min.x = real_min(b->min.x, other.min.x);
+    b->min.y = real_min(b->min.y, other.min.y);
+    b->min.z = real_min(b->min.z, other.min.z);
+    b->max.x = real_max(b->max.x, other.max.x);
+    b->max.y = real_max(b->max.y, other.max.y);
+    b->max.z = real_max(b->max.z, other.max.z);
+}
+
+static void grow_point(bounds * b, point p){
+    bounds pb;
+    pb.min = pb.max = p;
+    grow_bounds(b, pb);
+}
+
+/*half the surface area of the box, which is all the heuristic needs*/
+static double half_area(bounds b){
+    double dx = b.max.x - b.min.x, dy = b.max.y - b.min.y, dz = b.max.z - b.min.z;
+    if(dx < 0){
+        return 0;
+    }
+    return dx*dy + dy*dz + dz*dx;
+}
+
+/*axis used by the median split comparison*/
+static const point * sort_centers;
+static int sort_axis;
+
+static int compare_centers(const void * a, const void * b){
+    double ca = axis_of(sort_centers[*(const int *)a], sort_axis),
+           cb = axis_of(sort_centers[*(const int *)b], sort_axis);
+    return ca < cb ? -1 : ca > cb;
+}
+
+/*finds the cheapest binned SAH split of [begin, end), returns false if
+ * keeping a leaf is cheaper*/
+static bool sah_split(builder * bd, int begin, int end, bounds box, bounds cbox,
+        int * split_axis, double * split_pos){
+    int axis, i, b;
+    int n = end - begin;
+    double best_cost = n, leaf_area = half_area(box);
+    bool found = false;
+
+    for(axis = 0; axis < 3; ++axis){
+        int counts[SAH_BINS];
+        bounds bins[SAH_BINS], left;
+        double right_area[SAH_BINS];
+        int right_count[SAH_BINS], left_count = 0;
+        double lo = axis_of(cbox.min, axis), hi = axis_of(cbox.max, axis);
+        double scale;
+
+        if(hi - lo <= 0){
+            continue;
+        }
+        scale = SAH_BINS / (hi - lo);
+        for(b = 0; b < SAH_BINS; ++b){
+            counts[b] = 0;
+            bins[b] = empty_bounds();
+        }
+        for(i = begin; i < end; ++i){
+            int s = bd->order[i];
+            b = (int)((axis_of(bd->centers[s], axis) - lo) * scale);
+            if(b >= SAH_BINS){
+                b = SAH_BINS - 1;
+            }
+            ++counts[b];
+            grow_bounds(&bins[b], bd->boxes[s]);
+        }
+
+        /*sweep from the right, right_area[b] and right_count[b] describe
+         * bins (b, SAH_BINS)*/
+        left = empty_bounds();
+        right_count[SAH_BINS - 1] = 0;
+        for(b = SAH_BINS - 1; b > 0; --b){
+            grow_bounds(&left, bins[b]);
+            right_area[b - 1] = half_area(left);
+            right_count[b - 1] = right_count[b] + counts[b];
+        }
+
+        left = empty_bounds();
+        for(b = 0; b < SAH_BINS - 1; ++b){
+            double cost;
+            grow_bounds(&left, bins[b]);
+            left_count += counts[b];
+            if(left_count == 0 || right_count[b] == 0){
+                continue;
+            }
+            cost = 1.0 + (half_area(left) * left_count
+                    + right_area[b] * right_count[b]) / leaf_area;
+            if(cost < best_cost){
+                best_cost = cost;
+                *split_axis = axis;
+                *split_pos = lo + (b + 1) / scale;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+/*builds the subtree over order[begin, end) at node index, returns the
+ * index of the next free node*/
+static int build_node(builder * bd, int node, int begin, int end, int depth){
+    bvh_node * nd = &bd->tree->nodes[node];
+    bounds box = empty_bounds(), cbox = empty_bounds();
+    int i, mid, axis = 0, next;
+    double pos = 0;
+    bool split;
+
+    for(i = begin; i < end; ++i){
+        grow_bounds(&box, bd->boxes[bd->order[i]]);
+        grow_point(&cbox, bd->centers[bd->order[i]]);
+    }
+    nd->min = box.min;
+    nd->max = box.max;
+
+    if(end - begin <= 1){
+        nd->first = begin;
+        nd->count = end - begin;
+        return node + 1;
+    }
+
+    split = depth < MEDIAN_DEPTH && sah_split(bd, begin, end, box, cbox, &axis, &pos);
+    if(!split && end - begin <= MAX_LEAF_SIZE){
+        nd->first = begin;
+        nd->count = end - begin;
+        return node + 1;
+    }
+
+    mid = begin;
+    if(split){
+        /*partition around the chosen plane*/
+        int j = end - 1;
+        while(mid <= j){
+            if(axis_of(bd->centers[bd->order[mid]], axis) < pos){
+                ++mid;
+            } else {
+                int tmp = bd->order[mid];
+                bd->order[mid] = bd->order[j];
+                bd->order[j--] = tmp;
+            }
+        }
+    }
+    if(mid == begin || mid == end){
+        /*no useful plane, split at the median of the widest axis*/
+        double dx = cbox.max.x - cbox.min.x, dy = cbox.max.y - cbox.min.y,
+               dz = cbox.max.z - cbox.min.z;
+        sort_axis = dx >= dy && dx >= dz ? 0 : dy >= dz ? 1 : 2;
+        sort_centers = bd->centers;
+        qsort(bd->order + begin, end - begin, sizeof(int), compare_centers);
+        mid = begin + (end - begin) / 2;
+    }
+
+    nd->count = 0;
+    next = build_node(bd, node + 1, begin, mid, depth + 1);
+    bd->tree->nodes[node].first = next;
+    return build_node(bd, next, mid, end, depth + 1);
+}
+
+/*the boxes and spheres a ray through the root is expected to test, each
+ * node weighted by how likely the ray is to enter it (its area over the
+ * root's) and leaves by their sphere count too*/
+static double tree_cost(const bvh * tree){
+    double sum = 0, root;
+    bounds b;
+    int node;
+    for(node = 0; node < tree->node_count; ++node){
+        const bvh_node * nd = &tree->nodes[node];
+        b.min = nd->min;
+        b.max = nd->max;
+        sum += half_area(b) * (nd->count > 0 ? nd->count : 1);
+    }
+    if(tree->node_count == 0){
+        return 0;
+    }
+    b.min = tree->nodes[0].min;
+    b.max = tree->nodes[0].max;
+    root = half_area(b);
+    return root > 0 ? sum / root : 0;
+}
+
+/*builds the tree over the n spheres, replacing any previous tree*/
+void build_bvh(bvh * tree, const sphere_list * spheres, int n){
+    const sphere_list * sl;
+    builder bd;
+    int i;
+
+    free_bvh(tree);
+    tree->prim_count = n;
+    if(n == 0){
+        return;
+    }
+
+    bd.tree = tree;
+    bd.boxes = malloc(sizeof(bounds) * n);
+    bd.centers = malloc(sizeof(point) * n);
+    bd.order = malloc(sizeof(int) * n);
+    tree->prims = malloc(sizeof(sphere_list) * n);
+    tree->nodes = malloc(sizeof(bvh_node) * (2 * n - 1));
+
+    for(i = 0; i < n; ++i){
+        double r;
+        sl = &spheres[i];
+        r = sl->s.radius;
+        bd.centers[i] = sl->s.center;
+        bd.boxes[i].min.x = sl->s.center.x - r;
+        bd.boxes[i].min.y = sl->s.center.y - r;
+        bd.boxes[i].min.z = sl->s.center.z - r;
+        bd.boxes[i].max.x = sl->s.center.x + r;
+        bd.boxes[i].max.y = sl->s.center.y + r;
+        bd.boxes[i].max.z = sl->s.center.z + r;
+        bd.order[i] = i;
+    }
+
+    tree->node_count = build_node(&bd, 0, 0, n, 0);
+
+    /*store the spheres in leaf order*/
+    alloc_sphere_soa(&tree->soa, n);
+    for(i = 0; i < n; ++i){
+        tree->prims[i] = spheres[bd.order[i]];
+        set_soa_sphere(&tree->soa, i, tree->prims[i].s, i);
+    }
+
+    free(bd.boxes);
+    free(bd.centers);
+    tree->order = bd.order;
+    tree->built_cost = tree_cost(tree);
+}
+
+/*takes the geometry of the spheres of the list the tree was built from,
+ * which may have moved or changed size since, and fits every box to it.
+ * Children come after their parent, so going backwards through the
+ * nodes fits each box after the boxes inside it. The splits are kept,
+ * so the tree gets slower the further the spheres move from where it
+ * was built; once it costs REBUILD_GROWTH times what it did it is built
+ * again instead. Returns whether it was*/
+bool refit_bvh(bvh * tree, const sphere_list * spheres){
+    bounds box;
+    int i, node;
+
+    for(i = 0; i < tree->prim_count; ++i){
+        tree->prims[i].s = spheres[tree->order[i]].s;
+        set_soa_sphere(&tree->soa, i, tree->prims[i].s, i);
+    }
+    for(node = tree->node_count - 1; node >= 0; --node){
+        bvh_node * nd = &tree->nodes[node];
+        box = empty_bounds();
+        if(nd->count > 0){
+            for(i = nd->first; i < nd->first + nd->count; ++i){
+                sphere s = tree->prims[i].s;
+                bounds sb;
+                sb.min.x = s.center.x - s.radius;
+                sb.min.y = s.center.y - s.radius;
+                sb.min.z = s.center.z - s.radius;
+                sb.max.x = s.center.x + s.radius;
+                sb.max.y = s.center.y + s.radius;
+                sb.max.z = s.center.z + s.radius;
+                grow_bounds(&box, sb);
+            }
+        } else {
+            const bvh_node * left = &tree->nodes[node + 1], * right = &tree->nodes[nd->first];
+            box.min = left->min;
+            box.max = left->max;
+            grow_point(&box, right->min);
+            grow_point(&box, right->max);
+        }
+        nd->min = box.min;
+        nd->max = box.max;
+    }
+    if(tree_cost(tree) > REBUILD_GROWTH * tree->built_cost){
+        build_bvh(tree, spheres, tree->prim_count);
+        return true;
+    }
+    return false;
+}
+
+void free_bvh(bvh * tree){
+    free(tree->nodes);
+    free(tree->prims);
+    free(tree->order);
+    free_sphere_soa(&tree->soa);
+    tree->nodes = NULL;
+    tree->prims = NULL;
+    tree->order = NULL;
+    tree->built_cost = 0;
+    tree->node_count = tree->prim_count = 0;
+}
+
+/*whether a tree read from a file stays inside itself: leaves within the
+ * spheres, both children of an inner node after it and within the nodes
+ * (so every walk ends), no path deeper than the traversal stack and
+ * every sphere's material within the spheres*/
+bool check_bvh(const bvh * tree){
+    const bvh_node * nd;
+    int * depth, i;
+    bool ok = true;
+
+    if(tree->node_count == 0){
+        return tree->prim_count == 0;
+    }
+    /*children come after their parents, so a node's depth is final by
+     * the time the loop reaches it*/
+    depth = calloc(tree->node_count, sizeof(int));
+    for(i = 0; ok && i < tree->node_count; ++i){
+        nd = &tree->nodes[i];
+        if(nd->count > 0){
+            ok = nd->first >= 0 && nd->first <= tree->prim_count - nd->count;
+        } else {
+            ok = nd->count == 0 && i + 1 < tree->node_count && nd->first > i
+                && nd->first < tree->node_count && depth[i] + 1 < STACK_SIZE;
+            if(ok){
+                depth[i + 1] = depth[i + 1] > depth[i] + 1 ? depth[i + 1] : depth[i] + 1;
+                depth[nd->first] = depth[nd->first] > depth[i] + 1
+                    ? depth[nd->first] : depth[i] + 1;
+            }
+        }
+    }
+    for(i = 0; ok && i < tree->prim_count; ++i){
+        ok = tree->soa.material[i] >= 0 && tree->soa.material[i] < tree->prim_count;
+    }
+    free(depth);
+    return ok;
+}
+
+/*distance along r at which it enters the node's box, or REAL_MAX if it
+ * misses it. inv holds the reciprocals of the ray direction*/
+static real enter_box(const bvh_node * nd, ray r, vector inv){
+    real t1, t2, tmin = 0, tmax = REAL_MAX;
+
+    t1 = (nd->min.x - r.orgin.x) * inv.x;
+    t2 = (nd->max.x - r.orgin.x) * inv.x;
+    tmin = real_max(tmin, real_min(t1, t2));
+    tmax = real_min(tmax, real_max(t1, t2));
+
+    t1 = (nd->min.y - r.orgin.y) * inv.y;
+    t2 = (nd->max.y - r.orgin.y) * inv.y;
+    tmin = real_max(tmin, real_min(t1, t2));
+    tmax = real_min(tmax, real_max(t1, t2));
+
+    t1 = (nd->min.z - r.orgin.z) * inv.z;
+    t2 = (nd->max.z - r.orgin.z) * inv.z;
+    tmin = real_max(tmin, real_min(t1, t2));
+    tmax = real_min(tmax, real_max(t1, t2));
+
+    return tmin <= tmax ? tmin : REAL_MAX;
+}
+
+/*finds the closest sphere hit by r, filling hit, false if none is hit*/
+bool bvh_closest(const bvh * tree, ray r, hit_record * hit, ray_stats * stats){
+    int stack[STACK_SIZE], top = 0, node = 0, closest = -1, i;
+    real stack_t[STACK_SIZE];
+    vector d = ray_to_vector(r), inv;
+    real best = REAL_MAX, t;
+
+    hit->index = -1;
+    if(tree->node_count == 0){
+        return false;
+    }
+    inv.x = 1 / d.x;
+    inv.y = 1 / d.y;
+    inv.z = 1 / d.z;
+
+    STAT(++stats->box_tests);
+    if(enter_box(&tree->nodes[0], r, inv) == REAL_MAX){
+        return false;
+    }
+    for(;;){
+        const bvh_node * nd = &tree->nodes[node];
+        if(nd->count > 0){
+            STAT(stats->sphere_tests += nd->count);
+            i = nearest_sphere(&tree->soa, nd->first, nd->count, r, &best);
+            if(i >= 0){
+                closest = i;
+            }
+        } else {
+            int near = node + 1, far = nd->first;
+            real t_near = enter_box(&tree->nodes[near], r, inv),
+                   t_far = enter_box(&tree->nodes[far], r, inv);
+            STAT(stats->box_tests += 2);
+            if(t_far < t_near){
+                int tmp = near;
+                near = far;
+                far = tmp;
+                t = t_near;
+                t_near = t_far;
+                t_far = t;
+            }
+            /*children behind the closest hit cannot hold a closer one*/
+            if(t_far < best){
+                stack[top] = far;
+                stack_t[top++] = t_far;
+            }
+            if(t_near < best){
+                node = near;
+                continue;
+            }
+        }
+        /*pop, dropping nodes ruled out by hits found since they were pushed*/
+        do {
+            if(top == 0){
+                hit->t = best;
+                hit->index = closest;
+                return closest >= 0;
+            }
+            node = stack[--top];
+            t = stack_t[top];
+        } while(t >= best);
+    }
+}
+
+/*finds the closest sphere hit by r testing every sphere*/
+bool linear_closest(const bvh * tree, ray r, hit_record * hit, ray_stats * stats){
+    hit->t = REAL_MAX;
+    hit->index = nearest_sphere(&tree->soa, 0, tree->prim_count, r, &hit->t);
+    STAT(stats->sphere_tests += tree->prim_count);
+    return hit->index >= 0;
+}
+
+/*the index (into tree->soa) of a sphere r hits before reaching r.at, or
+ * -1 if none does. The first such sphere found is returned, not the
+ * nearest, and hint (an index, or -1) is tried before the tree*/
+int bvh_any_hit(const bvh * tree, ray r, int hint, ray_stats * stats){
+    int stack[STACK_SIZE], top = 0, node = 0, i;
+    vector d = ray_to_vector(r), inv;
+    real t = 1;
+
+    if(hint >= 0){
+        STAT(++stats->sphere_tests);
+        if(nearest_sphere(&tree->soa, hint, 1, r, &t) >= 0){
+            return hint;
+        }
+    }
+    if(tree->node_count == 0){
+        return -1;
+    }
+    inv.x = 1 / d.x;
+    inv.y = 1 / d.y;
+    inv.z = 1 / d.z;
+
+    for(;;){
+        const bvh_node * nd = &tree->nodes[node];
+        STAT(++stats->box_tests);
+        /*boxes entered past r.at cannot hold a blocker*/
+        if(enter_box(nd, r, inv) <= 1){
+            if(nd->count == 0){
+                stack[top++] = nd->first;
+                node = node + 1;
+                continue;
+            }
+            t = 1;
+            STAT(stats->sphere_tests += nd->count);
+            i = nearest_sphere(&tree->soa, nd->first, nd->count, r, &t);
+            if(i >= 0){
+                return i;
+            }
+        }
+        if(top == 0){
+            return -1;
+        }
+        node = stack[--top];
+    }
+}
+
+/*the same as bvh_any_hit testing every sphere*/
+int linear_any_hit(const bvh * tree, ray r, ray_stats * stats){
+    real t = 1;
+    STAT(stats->sphere_tests += tree->prim_count);
+    return nearest_sphere(&tree->soa, 0, tree->prim_count, r, &t);
+}
+
+/*lowest distance at which any ray starting in [omin, omax] with
+ * direction d can enter the node's box, or REAL_MAX if none can. This is
+ * the slab test done with intervals, so it may accept a box no ray hits
+ * but never rejects one that some ray does*/
+static real packet_enter_box(const bvh_node * nd, point omin, point omax,
+        vector d, vector inv){
+    real lo, hi, tmin = 0, tmax = REAL_MAX;
+    real bmin[3] = {nd->min.x, nd->min.y, nd->min.z},
+           bmax[3] = {nd->max.x, nd->max.y, nd->max.z},
+           pmin[3] = {omin.x, omin.y, omin.z}, pmax[3] = {omax.x, omax.y, omax.z},
+           dir[3] = {d.x, d.y, d.z}, rcp[3] = {inv.x, inv.y, inv.z};
+    int axis;
+
+    for(axis = 0; axis < 3; ++axis){
+        if(dir[axis] == 0){
+            if(pmax[axis] < bmin[axis] || pmin[axis] > bmax[axis]){
+                return REAL_MAX;
+            }
+            continue;
+        }
+        if(dir[axis] > 0){
+            lo = (bmin[axis] - pmax[axis]) * rcp[axis];
+            hi = (bmax[axis] - pmin[axis]) * rcp[axis];
+        } else {
+            lo = (bmax[axis] - pmin[axis]) * rcp[axis];
+            hi = (bmin[axis] - pmax[axis]) * rcp[axis];
+        }
+        tmin = real_max(tmin, lo);
+        tmax = real_min(tmax, hi);
+    }
+    return tmin <= tmax ? tmin : REAL_MAX;
+}
+
+/*finds the closest sphere for each of the n rays, which must all have the
+ * same direction (at - orgin). Nodes are culled against the whole bundle,
+ * only leaves are tested ray by ray*/
+void bvh_closest_packet(const bvh * tree, const ray * rays, int n, hit_record * hits,
+        ray_stats * stats){
+    int stack[STACK_SIZE], top = 0, node = 0, i, found;
+    real stack_t[STACK_SIZE];
+    vector d = ray_to_vector(rays[0]), inv;
+    point omin = rays[0].orgin, omax = rays[0].orgin;
+    real worst = REAL_MAX, t;
+
+    for(i = 0; i < n; ++i){
+        hits[i].t = REAL_MAX;
+        hits[i].index = -1;
+        omin.x = real_min(omin.x, rays[i].orgin.x);
+        omin.y = real_min(omin.y, rays[i].orgin.y);
+        omin.z = real_min(omin.z, rays[i].orgin.z);
+        omax.x = real_max(omax.x, rays[i].orgin.x);
+        omax.y = real_max(omax.y, rays[i].orgin.y);
+        omax.z = real_max(omax.z, rays[i].orgin.z);
+    }
+    if(tree->node_count == 0){
+        return;
+    }
+    inv.x = 1 / d.x;
+    inv.y = 1 / d.y;
+    inv.z = 1 / d.z;
+
+    STAT(++stats->box_tests);
+    if(packet_enter_box(&tree->nodes[0], omin, omax, d, inv) == REAL_MAX){
+        return;
+    }
+    for(;;){
+        const bvh_node * nd = &tree->nodes[node];
+        if(nd->count > 0){
+            worst = 0;
+            STAT(stats->box_tests += n);
+            for(i = 0; i < n; ++i){
+                if(enter_box(nd, rays[i], inv) < hits[i].t){
+                    STAT(stats->sphere_tests += nd->count);
+                    found = nearest_sphere(&tree->soa, nd->first, nd->count, rays[i],
+                            &hits[i].t);
+                    if(found >= 0){
+                        hits[i].index = found;
+                    }
+                }
+                worst = real_max(worst, hits[i].t);
+            }
+        } else {
+            int near = node + 1, far = nd->first;
+            real t_near = packet_enter_box(&tree->nodes[near], omin, omax, d, inv),
+                   t_far = packet_enter_box(&tree->nodes[far], omin, omax, d, inv);
+            STAT(stats->box_tests += 2);
+            if(t_far < t_near){
+                int tmp = near;
+                near = far;
+                far = tmp;
+                t = t_near;
+                t_near = t_far;
+                t_far = t;
+            }
+            /*boxes behind every ray's closest hit are skipped*/
+            if(t_far < worst){
+                stack[top] = far;
+                stack_t[top++] = t_far;
+            }
+            if(t_near < worst){
+                node = near;
+                continue;
+            }
+        }
+        do {
+            if(top == 0){
+                return;
+            }
+            node = stack[--top];
+            t = stack_t[top];
+        } while(t >= worst);
+    }
+}
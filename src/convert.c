@@ -0,0 +1,80 @@
+/*********************
+ * Scene file converter: reads a scene in either format and writes it as
+ * a binary scene (built and ready to map) or, with --text, as text. The
+ * input may also be "builtin" for the scene the viewer shows by default,
+ * or "random:N[:SEED[:LIGHTS]]" for the benchmark's synthetic scene of N
+ * spheres, with LIGHTS point lights added.
+ *
+ * read_input - loads, builds or generates the input scene
+ */
+#include "scene.h"
+#include "scenefile.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void print_convert_usage(const char * program){
+    fprintf(stderr,
+        "usage: %s [--text] input output\n"
+        "  input            a scene file, builtin or random:N[:SEED[:LIGHTS]]\n"
+        "  --text           write the text format (default: binary)\n", program);
+}
+
+/*fills sc from the input named on the command line*/
+static bool read_input(scene * sc, const char * input){
+    char * end;
+    long count, lights = 0;
+    unsigned long long seed = 1;
+
+    if(strcmp(input, "builtin") == 0){
+        setup_scene(sc);
+        return true;
+    }
+    if(strncmp(input, "random:", 7) == 0){
+        count = strtol(input + 7, &end, 10);
+        if(*end == ':'){
+            seed = strtoull(end + 1, &end, 10);
+        }
+        if(*end == ':'){
+            lights = strtol(end + 1, &end, 10);
+        }
+        if(end == input + 7 || *end != '\0' || count <= 0 || lights < 0){
+            fprintf(stderr, "%s: bad random scene\n", input);
+            return false;
+        }
+        random_scene(sc, (int)count, seed);
+        if(lights > 0){
+            random_lights(sc, (int)lights, seed);
+        }
+        return true;
+    }
+    return load_scene(sc, input);
+}
+
+int main(int argc, char ** argv){
+    bool text = false, ok;
+    int first = 1;
+    scene sc;
+
+    if(argc > 1 && strcmp(argv[1], "--text") == 0){
+        text = true;
+        first = 2;
+    }
+    if(argc - first != 2){
+        print_convert_usage(argv[0]);
+        return 2;
+    }
+    if(!read_input(&sc, argv[first])){
+        return 1;
+    }
+
+    ok = text ? save_scene_text(&sc, argv[first + 1])
+              : save_scene_binary(&sc, argv[first + 1]);
+    if(!ok){
+        perror(argv[first + 1]);
+    }
+    free_scene(&sc);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,553 @@
+/*********************
+ * A farm of processes tracing one frame, over Unix domain or TCP sockets.
+ *
+ * farm_frame - listens for workers and hands the frame out to them
+ * run_worker - connects to a farm and traces the jobs it sends
+ *
+ * Every message is a farm_message header then size bytes of payload. The
+ * farm keeps the state of each row of tiles: done, with a worker, or
+ * waiting. A worker gets the waiting rows from the bottom up, enough for
+ * two tiles for each of its threads, and a new job once it has answered.
+ * Rows go back to waiting when their worker leaves or stalls; a stalled
+ * worker that answers after all is still heard, its rows are kept unless
+ * another worker got there first.
+ */
+#include "farm.h"
+#include "net.h"
+#include "scene.h"
+#include "scenefile.h"
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FARM_MAGIC 0x52464d31u      /*"RFM1"*/
+#define FARM_BYTE_ORDER 0x01020304u
+#define MAX_FARM_WORKERS 256
+/*how often a worker tries to reach a farm that is not listening yet, and
+ * how long it waits between tries*/
+#define CONNECT_TRIES 100
+#define CONNECT_WAIT_NS 100000000L
+/*longest the farm sleeps in poll, so stalls are noticed in time*/
+#define FARM_POLL_MS 100
+
+typedef enum {
+    FARM_HELLO = 1,     /*farm to worker: farm_settings, then the scene file*/
+    FARM_READY,         /*worker to farm: scene loaded, a is its thread count*/
+    FARM_JOB,           /*farm to worker: trace the b tile rows from a*/
+    FARM_ROWS,          /*worker to farm: the pixels of the job a, b*/
+    FARM_DONE           /*farm to worker: the frame is finished*/
+} farm_type;
+
+typedef struct farm_message_struct {
+    uint32_t type;
+    uint32_t a, b;
+    uint32_t unused;
+    uint64_t size;      /*bytes of payload after the header*/
+} farm_message;
+
+/*what a worker needs to trace the farm's frame, besides the scene. The
+ * first four fields tell a worker it speaks the same protocol and lays
+ * out colors the same way*/
+typedef struct farm_settings_struct {
+    uint32_t magic, byte_order, real_size, color_size;
+    int32_t width, height, tile_size, packet_size, max_depth;
+    int32_t wavefront, use_bvh, shadows, occluder_cache, use_light_grid, roulette;
+    double extent_width, extent_height, min_weight;
+} farm_settings;
+
+/*a connected worker as the farm sees it*/
+typedef struct farm_worker_struct {
+    int fd;
+    int id;                 /*in order of connecting, for messages and rows*/
+    bool ready;             /*has loaded the scene*/
+    int rows_per_job;
+    int first, count;       /*rows of the job it has, count 0 for none*/
+    bool stalled;           /*its rows were handed on, it is not given more*/
+    struct timespec issued;
+} farm_worker;
+
+/*where the rows of the frame are*/
+typedef struct farm_rows_struct {
+    int count;
+    int done;               /*rows traced*/
+    bool * traced;
+    int * owner;            /*the id of the worker tracing a row, -1 for none*/
+} farm_rows;
+
+static double seconds_since(struct timespec start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*sends a header and size bytes of payload*/
+static bool send_message(int fd, farm_type type, int a, int b, const void * payload,
+        size_t size){
+    farm_message m;
+    memset(&m, 0, sizeof(m));
+    m.type = type;
+    m.a = a;
+    m.b = b;
+    m.size = size;
+    return write_all(fd, &m, sizeof(m)) && write_all(fd, payload, size);
+}
+
+/*reads all of path into *data*/
+static bool read_file(const char * path, char ** data, size_t * size){
+    FILE * f = fopen(path, "rb");
+    long length;
+    bool ok;
+    if(f == NULL){
+        return false;
+    }
+    ok = fseek(f, 0, SEEK_END) == 0 && (length = ftell(f)) >= 0
+        && fseek(f, 0, SEEK_SET) == 0;
+    if(ok){
+        *size = length;
+        *data = malloc(length > 0 ? length : 1);
+        ok = fread(*data, 1, length, f) == (size_t)length;
+    }
+    fclose(f);
+    return ok;
+}
+
+static void fill_settings(farm_settings * s, const render_options * opts,
+        const renderer * rd){
+    memset(s, 0, sizeof(farm_settings));
+    s->magic = FARM_MAGIC;
+    s->byte_order = FARM_BYTE_ORDER;
+    s->real_size = sizeof(real);
+    s->color_size = sizeof(color);
+    s->width = opts->width;
+    s->height = opts->height;
+    s->tile_size = rd->tile_size;
+    s->packet_size = rd->packet_size;
+    s->max_depth = opts->max_depth;
+    s->wavefront = opts->wavefront;
+    s->use_bvh = opts->use_bvh;
+    s->shadows = opts->shadows;
+    s->occluder_cache = opts->occluder_cache;
+    s->use_light_grid = opts->use_light_grid;
+    s->roulette = opts->roulette;
+    s->extent_width = opts->extent_width;
+    s->extent_height = opts->extent_height;
+    s->min_weight = opts->min_weight;
+}
+
+/*hands the rows worker w has back to waiting, unless already handed on*/
+static void release_rows(farm_rows * rows, const farm_worker * w){
+    int r;
+    for(r = w->first; r < w->first + w->count; ++r){
+        if(rows->owner[r] == w->id){
+            rows->owner[r] = -1;
+        }
+    }
+}
+
+/*gives w the lowest run of waiting rows, if any are left*/
+static bool give_job(farm_rows * rows, farm_worker * w){
+    int first = 0, count = 0;
+    while(first < rows->count && (rows->traced[first] || rows->owner[first] >= 0)){
+        ++first;
+    }
+    while(first + count < rows->count && count < w->rows_per_job
+            && !rows->traced[first + count] && rows->owner[first + count] < 0){
+        rows->owner[first + count] = w->id;
+        ++count;
+    }
+    if(count == 0){
+        return true;
+    }
+    w->first = first;
+    w->count = count;
+    clock_gettime(CLOCK_MONOTONIC, &w->issued);
+    return send_message(w->fd, FARM_JOB, first, count, NULL, 0);
+}
+
+/*reads one message from worker w into the frame; false when w is gone or
+ * says something it should not*/
+static bool hear_worker(renderer * rd, farm_rows * rows, farm_worker * w,
+        color ** scratch, size_t * scratch_size){
+    framebuffer * fb = &rd->canvas;
+    farm_message m;
+    size_t expected;
+    int r, row0, row_end, y;
+
+    if(!read_all(w->fd, &m, sizeof(m))){
+        return false;
+    }
+    if(m.type == FARM_READY && !w->ready && m.size == 0 && m.a > 0){
+        /*two tiles a thread keep the worker's threads busy to the end*/
+        int tiles_x = (fb->width + rd->tile_size - 1) / rd->tile_size;
+        w->ready = true;
+        w->rows_per_job = (2 * (int)m.a + tiles_x - 1) / tiles_x;
+        if(w->rows_per_job > rows->count){
+            w->rows_per_job = rows->count;
+        }
+        return true;
+    }
+    if(m.type != FARM_ROWS || w->count == 0 || (int)m.a != w->first
+            || (int)m.b != w->count){
+        return false;
+    }
+    row0 = w->first * rd->tile_size;
+    row_end = (w->first + w->count) * rd->tile_size;
+    if(row_end > fb->height){
+        row_end = fb->height;
+    }
+    expected = sizeof(color) * (size_t)fb->stride * (row_end - row0);
+    if(m.size != expected){
+        return false;
+    }
+    if(*scratch_size < expected){
+        free(*scratch);
+        *scratch = malloc(expected);
+        *scratch_size = expected;
+    }
+    if(!read_all(w->fd, *scratch, expected)){
+        return false;
+    }
+    /*the first answer for a row is the one kept*/
+    for(r = w->first; r < w->first + w->count; ++r){
+        if(rows->traced[r]){
+            continue;
+        }
+        for(y = r * rd->tile_size; y < (r + 1) * rd->tile_size && y < fb->height; ++y){
+            memcpy(fb->pixels + (size_t)y * fb->stride,
+                    *scratch + (size_t)(y - row0) * fb->stride,
+                    sizeof(color) * fb->width);
+        }
+        rows->traced[r] = true;
+        rows->owner[r] = -1;
+        ++rows->done;
+    }
+    w->count = 0;
+    w->stalled = false;
+    return true;
+}
+
+/*takes a worker that connected to listener and sends it the frame's
+ * settings and scene; false if it could not be reached*/
+static bool greet_worker(int listener, farm_worker * w, const farm_settings * settings,
+        const char * scene_data, size_t scene_size, double timeout){
+    struct timeval tv;
+    farm_message m;
+
+    w->fd = accept(listener, NULL, NULL);
+    if(w->fd < 0){
+        return false;
+    }
+    /*a worker that stops reading or writing mid-message is given up on*/
+    tv.tv_sec = (time_t)timeout;
+    tv.tv_usec = (suseconds_t)((timeout - tv.tv_sec) * 1e6);
+    setsockopt(w->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(w->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    w->ready = false;
+    w->count = 0;
+    w->stalled = false;
+    memset(&m, 0, sizeof(m));
+    m.type = FARM_HELLO;
+    m.size = sizeof(farm_settings) + scene_size;
+    if(write_all(w->fd, &m, sizeof(m)) && write_all(w->fd, settings, sizeof(farm_settings))
+            && write_all(w->fd, scene_data, scene_size)){
+        return true;
+    }
+    close(w->fd);
+    return false;
+}
+
+/*traces the frame on the workers that connect to opts->farm, into the
+ * canvas of rd. Returns once every row is in, false if the farm could
+ * not be set up*/
+bool farm_frame(renderer * rd, const render_options * opts){
+    farm_worker workers[MAX_FARM_WORKERS];
+    struct pollfd fds[MAX_FARM_WORKERS + 1];
+    farm_settings settings;
+    farm_rows rows;
+    color * scratch = NULL;
+    size_t scratch_size = 0, scene_size = 0;
+    char * scene_data = NULL;
+    int listener, count = 0, connected = 0, handed_on = 0, i, n;
+
+    if(opts->scene_file != NULL && !read_file(opts->scene_file, &scene_data, &scene_size)){
+        perror(opts->scene_file);
+        return false;
+    }
+    listener = open_address(opts->farm, true);
+    if(listener < 0){
+        if(errno != 0){
+            perror(opts->farm);
+        }
+        free(scene_data);
+        return false;
+    }
+    fill_settings(&settings, opts, rd);
+    rows.count = (rd->canvas.height + rd->tile_size - 1) / rd->tile_size;
+    rows.done = 0;
+    rows.traced = calloc(rows.count, sizeof(bool));
+    rows.owner = malloc(sizeof(int) * rows.count);
+    for(i = 0; i < rows.count; ++i){
+        rows.owner[i] = -1;
+    }
+    fprintf(stderr, "farming %d rows of tiles out on %s\n", rows.count, opts->farm);
+
+    while(rows.done < rows.count){
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for(i = 0; i < count; ++i){
+            fds[i + 1].fd = workers[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        n = poll(fds, count + 1, FARM_POLL_MS);
+        if(n < 0 && errno != EINTR){
+            perror("poll");
+            break;
+        }
+        for(i = 0; n > 0 && i < count; ++i){
+            farm_worker * w = &workers[i];
+            if(fds[i + 1].revents == 0){
+                continue;
+            }
+            if(!hear_worker(rd, &rows, w, &scratch, &scratch_size)){
+                fprintf(stderr, "worker %d went away%s\n", w->id,
+                        w->count > 0 && !w->stalled ? ", handing its rows on" : "");
+                release_rows(&rows, w);
+                close(w->fd);
+                w->fd = -1;
+            }
+        }
+        if(n > 0 && (fds[0].revents & POLLIN) && count < MAX_FARM_WORKERS){
+            workers[count].id = connected++;
+            if(greet_worker(listener, &workers[count], &settings, scene_data, scene_size,
+                        opts->farm_timeout)){
+                ++count;
+            }
+        }
+        /*drops the workers that went, hands out jobs and looks for stalls*/
+        for(i = n = 0; i < count; ++i){
+            farm_worker * w = &workers[i];
+            if(w->fd < 0){
+                continue;
+            }
+            if(w->count > 0 && !w->stalled && seconds_since(w->issued) > opts->farm_timeout){
+                fprintf(stderr, "worker %d stalled, handing its rows on\n", w->id);
+                release_rows(&rows, w);
+                w->stalled = true;
+                ++handed_on;
+            }
+            if(w->ready && w->count == 0 && !give_job(&rows, w)){
+                fprintf(stderr, "worker %d went away, handing its rows on\n", w->id);
+                release_rows(&rows, w);
+                close(w->fd);
+                continue;
+            }
+            workers[n++] = *w;
+        }
+        count = n;
+    }
+
+    for(i = 0; i < count; ++i){
+        send_message(workers[i].fd, FARM_DONE, 0, 0, NULL, 0);
+        close(workers[i].fd);
+    }
+    close_address(listener, opts->farm);
+    fprintf(stderr, "%d workers traced the frame, %d stalled\n", connected, handed_on);
+    free(rows.traced);
+    free(rows.owner);
+    free(scratch);
+    free(scene_data);
+    return rows.done == rows.count;
+}
+
+/*connects to the farm at address, trying again for a while in case it
+ * is not listening yet*/
+static int connect_farm(const char * address){
+    struct timespec wait = {0, CONNECT_WAIT_NS};
+    int fd = -1, tries;
+    for(tries = 0; fd < 0 && tries < CONNECT_TRIES; ++tries){
+        errno = 0;
+        fd = open_address(address, false);
+        if(fd < 0 && errno != ECONNREFUSED && errno != ENOENT){
+            break;
+        }
+        if(fd < 0){
+            nanosleep(&wait, NULL);
+        }
+    }
+    if(fd < 0 && errno != 0){
+        perror(address);
+    }
+    return fd;
+}
+
+/*whether the farm's settings are within the limits parse_options holds
+ * the command line to, so a farm cannot send a worker where its own
+ * options could not*/
+static bool settings_in_range(const farm_settings * s){
+    return s->width > 0 && s->height > 0
+        && (int64_t)s->width * s->height <= MAX_PIXELS
+        && s->tile_size > 0 && s->tile_size <= MAX_TILE
+        && s->packet_size >= 0 && s->packet_size <= 8
+        && s->packet_size * s->packet_size <= MAX_PACKET
+        && s->max_depth >= 0 && s->max_depth <= MAX_DEPTH
+        && s->extent_width >= 0 && isfinite(s->extent_width)
+        && s->extent_height >= 0 && isfinite(s->extent_height)
+        && s->min_weight >= 0 && isfinite(s->min_weight);
+}
+
+/*reads the farm's hello: its settings into wopts, its scene into sc*/
+static bool read_hello(int fd, const char * address, render_options * wopts, scene * sc){
+    farm_message m;
+    farm_settings s;
+    char name[] = "/tmp/rayfoo-farm-XXXXXX", buffer[65536];
+    uint64_t left;
+    size_t n;
+    FILE * f;
+    bool ok;
+    int tmp;
+
+    if(!read_all(fd, &m, sizeof(m)) || m.type != FARM_HELLO || m.size < sizeof(s)
+            || !read_all(fd, &s, sizeof(s))){
+        fprintf(stderr, "%s: not a farm\n", address);
+        return false;
+    }
+    if(s.magic != FARM_MAGIC || s.byte_order != FARM_BYTE_ORDER
+            || s.real_size != sizeof(real) || s.color_size != sizeof(color)){
+        fprintf(stderr, "%s: the farm runs another build (precision or byte order)\n",
+                address);
+        return false;
+    }
+    if(!settings_in_range(&s)){
+        fprintf(stderr, "%s: the farm's settings are out of range\n", address);
+        return false;
+    }
+    wopts->width = s.width;
+    wopts->height = s.height;
+    wopts->tile_size = s.tile_size;
+    wopts->packet_size = s.packet_size;
+    wopts->max_depth = s.max_depth;
+    wopts->wavefront = s.wavefront;
+    wopts->use_bvh = s.use_bvh;
+    wopts->shadows = s.shadows;
+    wopts->occluder_cache = s.occluder_cache;
+    wopts->use_light_grid = s.use_light_grid;
+    wopts->roulette = s.roulette;
+    wopts->extent_width = s.extent_width;
+    wopts->extent_height = s.extent_height;
+    wopts->min_weight = s.min_weight;
+
+    left = m.size - sizeof(s);
+    if(left == 0){
+        setup_scene(sc);
+        return true;
+    }
+    /*load_scene reads files, so the scene goes through one for a moment*/
+    tmp = mkstemp(name);
+    if(tmp < 0 || (f = fdopen(tmp, "wb")) == NULL){
+        perror(name);
+        return false;
+    }
+    ok = true;
+    while(ok && left > 0){
+        n = left < sizeof(buffer) ? left : sizeof(buffer);
+        ok = read_all(fd, buffer, n) && fwrite(buffer, 1, n, f) == n;
+        left -= n;
+    }
+    ok = fclose(f) == 0 && ok;
+    if(!ok){
+        fprintf(stderr, "%s: could not take the scene\n", address);
+    }
+    ok = ok && load_scene(sc, name);
+    unlink(name);
+    return ok;
+}
+
+/*traces the jobs of the farm at opts->worker until it says it is done,
+ * with opts->threads threads; the exit status for main*/
+int run_worker(const render_options * opts){
+    render_options wopts = *opts;
+    renderer rd;
+    scene sc;
+    farm_message m;
+    color * band = NULL;
+    size_t band_size = 0, size;
+    int fd, jobs = 0, traced = 0, rows, tile_rows, status = 1;
+    char discard[4096];
+
+    fd = connect_farm(opts->worker);
+    if(fd < 0){
+        return 1;
+    }
+    if(!read_hello(fd, opts->worker, &wopts, &sc)){
+        close(fd);
+        return 1;
+    }
+    wopts.headless = true;
+    wopts.stream = false;
+    wopts.aa = 1;
+    wopts.hit_cache = false;
+    configure_scene(&sc, &wopts);
+    init_renderer(&rd, &wopts);
+    tile_rows = (rd.canvas.height + rd.tile_size - 1) / rd.tile_size;
+
+    if(!send_message(fd, FARM_READY, pool_threads(rd.pool), 0, NULL, 0)){
+        fprintf(stderr, "%s: lost the farm\n", opts->worker);
+    }
+    while(read_all(fd, &m, sizeof(m))){
+        if(m.type == FARM_DONE){
+            status = 0;
+            break;
+        }
+        /*checked apart, a + b may wrap*/
+        if(m.type != FARM_JOB || m.b == 0 || m.a >= (uint32_t)tile_rows
+                || m.b > (uint32_t)tile_rows - m.a){
+            fprintf(stderr, "%s: bad job\n", opts->worker);
+            break;
+        }
+        /*image rows of the job, the last row of tiles may be cut short*/
+        rows = (int)m.b * rd.tile_size;
+        if((int)(m.a + m.b) * rd.tile_size > rd.canvas.height){
+            rows = rd.canvas.height - (int)m.a * rd.tile_size;
+        }
+        ++jobs;
+        if(jobs == opts->drop_after){
+            fprintf(stderr, "worker dropping job %d\n", jobs);
+            break;
+        }
+        if(jobs == opts->stall_after){
+            /*answers nothing more until the farm hangs up*/
+            fprintf(stderr, "worker stalling at job %d\n", jobs);
+            while(recv(fd, discard, sizeof(discard), 0) > 0){
+            }
+            break;
+        }
+        size = sizeof(color) * (size_t)rd.canvas.stride * rows;
+        if(size > band_size){
+            free(band);
+            band = malloc(size);
+            band_size = size;
+        }
+        trace_band(&rd, &sc, m.a, m.b, band);
+        if(!send_message(fd, FARM_ROWS, m.a, m.b, band, size)){
+            break;
+        }
+        ++traced;
+    }
+    if(status != 0 && jobs != opts->drop_after && jobs != opts->stall_after){
+        fprintf(stderr, "%s: lost the farm\n", opts->worker);
+    }
+    printf("traced %d jobs for %s\n", traced, opts->worker);
+    close(fd);
+    free(band);
+    destroy_renderer(&rd);
+    free_scene(&sc);
+    return status;
+}
@@ -0,0 +1,56 @@
+/*********************
+ * Hit cache of the last full render.
+ *
+ * shade_gbuffer - recolors a range of pixels from their cached hits under
+ *                  the scene's current light
+ */
+#include "gbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*makes gb a cache of depth hits for each of pixels, false (leaving it
+ * empty) when there is not the memory for it*/
+bool init_gbuffer(gbuffer * gb, int pixels, int depth){
+    size_t slots = (size_t)pixels * depth;
+    gb->hits = malloc(sizeof(gbuffer_hit) * (slots > 0 ? slots : 1));
+    gb->count = calloc(pixels > 0 ? pixels : 1, sizeof(int));
+    gb->pixels = pixels;
+    gb->depth = depth;
+    gb->valid = false;
+    if(gb->hits == NULL || gb->count == NULL){
+        free_gbuffer(gb);
+        return false;
+    }
+    return true;
+}
+
+void free_gbuffer(gbuffer * gb){
+    free(gb->hits);
+    free(gb->count);
+    memset(gb, 0, sizeof(gbuffer));
+}
+
+/*recolors the pixels [first, last) of canvas without casting a ray
+ * other than shadow rays toward the new light, adding what it traced to
+ * stats*/
+void shade_gbuffer(const gbuffer * gb, const scene * sc, int first, int last,
+        color * canvas, ray_stats * stats){
+    color black = {BLACK}, c;
+    int pixel, i;
+    tracer tr;
+
+    init_tracer(&tr, sc, first);
+    for(pixel = first; pixel < last; ++pixel){
+        const gbuffer_hit * h = &gb->hits[(size_t)pixel*gb->depth];
+        color sum = black;
+        for(i = 0; i < gb->count[pixel]; ++i, ++h){
+            c = light_hit(&tr, h->sphere, h->p, h->normal, h->view);
+            sum.r += h->weight * c.r;
+            sum.g += h->weight * c.g;
+            sum.b += h->weight * c.b;
+        }
+        canvas[pixel] = sum;
+    }
+    add_stats(stats, &tr.stats);
+}
@@ -0,0 +1,159 @@
+/*********************
+ * Offline rendering: builds or loads the scene, traces it into the
+ * renderer's canvas and writes that to the requested image file. No GLUT,
+ * no window, no event loop. With --stream there is no canvas, the image
+ * is written a band at a time while the rest is traced.
+ *
+ * A scene with keyframes is rendered as a numbered image per frame, the
+ * scene posed for each in turn with the same renderer, threads and tree.
+ *
+ * With --farm the frame's tiles are traced by worker processes instead,
+ * and with --worker this process is one of them. With --serve it renders
+ * what it is asked on a socket until told to stop.
+ *
+ * frame_path - the image file of one frame of a sequence
+ * render_frame - traces the scene as posed and writes it
+ */
+#include "headless.h"
+#include "farm.h"
+#include "image.h"
+#include "render.h"
+#include "server.h"
+#include "scene.h"
+#include "scenefile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*seconds between two monotonic time stamps*/
+static double elapsed(struct timespec start, struct timespec end){
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*writes the image file of frame to name: path with the frame number,
+ * digits long, put before its extension (out.png becomes out_0007.png)*/
+static void frame_path(char * name, size_t size, const char * path, int frame,
+        int digits){
+    const char * dot = strrchr(path, '.'), * slash = strrchr(path, '/');
+    int stem = dot == NULL || (slash != NULL && dot < slash)
+        ? (int)strlen(path) : (int)(dot - path);
+    snprintf(name, size, "%.*s_%0*d%s", stem, path, digits, frame, path + stem);
+}
+
+/*traces sc as it is posed and writes the image to path*/
+static bool render_frame(renderer * rd, const scene * sc, const render_options * opts,
+        const char * path){
+    image_writer out;
+    bool ok;
+
+    if(opts->stream){
+        ok = open_image(&out, path, rd->canvas.width, rd->canvas.height);
+        if(ok){
+            ok = stream_scene(rd, sc, &out);
+            ok = close_image(&out) && ok;
+        }
+        return ok;
+    }
+    if(opts->farm != NULL){
+        if(!farm_frame(rd, opts)){
+            return false;
+        }
+    } else {
+        compute_scene(rd, sc);
+    }
+    return write_image(path, rd->canvas.pixels, rd->canvas.width, rd->canvas.height,
+            rd->canvas.stride);
+}
+
+int run_headless(const render_options * opts){
+    struct timespec start, end, setup = phase_start(), pose;
+    renderer rd;
+    ray_stats st;
+    scene sc;
+    const char * path = opts->output;
+    char * name = NULL;
+    size_t name_size = strlen(opts->output) + 32;
+    int threads, frames, frame, n, digits = 4;
+    bool ok = true;
+
+    if(opts->worker != NULL){
+        return run_worker(opts);
+    }
+    if(opts->serve != NULL){
+        return run_server(opts);
+    }
+    if(opts->farm != NULL && (opts->stream || opts->aa > 1)){
+        fprintf(stderr, "--farm cannot be used with --stream or --aa\n");
+        return 2;
+    }
+    if(opts->scene_file == NULL){
+        setup_scene(&sc);
+    } else if(!load_scene(&sc, opts->scene_file)){
+        return 1;
+    }
+    if(opts->farm != NULL && sc.anim.frame_count > 0){
+        fprintf(stderr, "%s: --farm renders still scenes only\n", opts->scene_file);
+        free_scene(&sc);
+        return 2;
+    }
+    configure_scene(&sc, opts);
+    init_renderer(&rd, opts);
+    phase_end(&rd.times, PHASE_SETUP, setup);
+
+    frames = sc.anim.frame_count > 0 ? sc.anim.frame_count : 1;
+    if(sc.anim.frame_count > 0){
+        name = malloc(name_size);
+        /*enough digits for the last frame, so the names sort in order*/
+        for(n = frames - 1; n >= 10000; n /= 10){
+            ++digits;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(frame = 0; ok && frame < frames; ++frame){
+        if(sc.anim.frame_count > 0){
+            pose = phase_start();
+            pose_scene(&sc, frame);
+            phase_end(&rd.times, PHASE_POSE, pose);
+            frame_path(name, name_size, opts->output, frame, digits);
+            path = name;
+        }
+        ok = render_frame(&rd, &sc, opts, path);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    threads = pool_threads(rd.pool);
+    render_stats(&rd, &st);
+    if(opts->stats){
+        print_render_stats(stdout, &rd, opts->stats_json);
+    }
+    destroy_renderer(&rd);
+    free_scene(&sc);
+
+    if(!ok){
+        perror(path);
+        free(name);
+        return 1;
+    }
+
+    if(name != NULL){
+        printf("rendered %d frames of %dx%d on %d threads in %.3f s, %.3f s a frame -> %s\n",
+                frames, opts->width, opts->height, threads, elapsed(start, end),
+                elapsed(start, end) / frames, name);
+        free(name);
+    } else if(opts->farm != NULL){
+        printf("rendered %dx%d on the farm at %s in %.3f s -> %s\n", opts->width,
+                opts->height, opts->farm, elapsed(start, end), opts->output);
+    } else {
+        printf("rendered %dx%d on %d threads in %.3f s -> %s\n", opts->width, opts->height,
+                threads, elapsed(start, end), opts->output);
+    }
+    if(opts->aa > 1 && !opts->stream){
+        printf("anti-aliasing cast %llu extra rays, %.3f per pixel (%d samples of "
+               "every pixel would be %d)\n", st.aa_rays,
+               st.aa_rays / ((double)opts->width * opts->height * frames), opts->aa,
+               opts->aa - 1);
+    }
+    return 0;
+}
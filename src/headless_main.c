@@ -0,0 +1,18 @@
+/*********************
+ * Entry point of rayfoo-headless, the renderer without any OpenGL in
+ * the link. Usage is the same as rayfoo --headless.
+ */
+#include "headless.h"
+#include "options.h"
+
+int main(int argc, char ** argv){
+    render_options opts;
+
+    default_options(&opts);
+    if(!parse_options(argc, argv, &opts, false)){
+        print_usage(argv[0]);
+        return 2;
+    }
+    opts.headless = true;
+    return run_headless(&opts);
+}
@@ -0,0 +1,268 @@
+/*********************
+ * Image output for the headless renderer, and input for comparing
+ * renders.
+ *
+ * open_image - starts an image file, PNG for a .png extension and
+ *                  binary (P6) portable pixmap otherwise
+ * write_rows - appends rows, so an image can be written a band at a time
+ *                  as it is traced
+ * close_image - finishes the file
+ * write_image - writes a whole buffer
+ *
+ * PNGs use stored (uncompressed) deflate blocks so no compression library
+ * is needed, each call to write_rows adding one IDAT chunk.
+ * read_ppm - reads a binary portable pixmap as written by write_ppm
+ * pack_rgba - converts colors to the 8 bit RGBA the viewer's texture
+ *                  holds
+ */
+#include "image.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*converts a color channel to an 8 bit value, clamping at [0, 1]*/
+static unsigned char to_byte(float c){
+    if(c <= 0){
+        return 0;
+    }
+    if(c >= 1){
+        return 255;
+    }
+    return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+/*packs one row of the buffer as RGB bytes*/
+static void pack_row(unsigned char * out, const color * row, int width){
+    int x;
+    for(x = 0; x < width; ++x){
+        out[3*x] = to_byte(row[x].r);
+        out[3*x + 1] = to_byte(row[x].g);
+        out[3*x + 2] = to_byte(row[x].b);
+    }
+}
+
+/*packs count colors as RGBA bytes, opaque*/
+void pack_rgba(unsigned char * out, const color * pixels, int count){
+    int i;
+    for(i = 0; i < count; ++i){
+        out[4*i] = to_byte(pixels[i].r);
+        out[4*i + 1] = to_byte(pixels[i].g);
+        out[4*i + 2] = to_byte(pixels[i].b);
+        out[4*i + 3] = 255;
+    }
+}
+
+static uint32_t crc_table[256];
+
+static void init_crc_table(){
+    uint32_t c, n, k;
+    for(n = 0; n < 256; ++n){
+        c = n;
+        for(k = 0; k < 8; ++k){
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t update_crc(uint32_t crc, const unsigned char * buf, size_t len){
+    size_t i;
+    for(i = 0; i < len; ++i){
+        crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void put_u32(unsigned char * out, uint32_t v){
+    out[0] = v >> 24;
+    out[1] = v >> 16;
+    out[2] = v >> 8;
+    out[3] = v;
+}
+
+/*writes a PNG chunk, data may be NULL when len is 0*/
+static void write_chunk(FILE * f, const char * type, const unsigned char * data, uint32_t len){
+    unsigned char buf[4];
+    uint32_t crc = 0xffffffffu;
+
+    put_u32(buf, len);
+    fwrite(buf, 1, 4, f);
+    fwrite(type, 1, 4, f);
+    crc = update_crc(crc, (const unsigned char *)type, 4);
+    if(len > 0){
+        fwrite(data, 1, len, f);
+        crc = update_crc(crc, data, len);
+    }
+    put_u32(buf, crc ^ 0xffffffffu);
+    fwrite(buf, 1, 4, f);
+}
+
+/*writes len bytes of the chunk being written, adding them to its CRC*/
+static void chunk_bytes(image_writer * w, const void * data, size_t len){
+    fwrite(data, 1, len, w->f);
+    w->crc = update_crc(w->crc, data, len);
+}
+
+/*the header of a stored deflate block holding len bytes*/
+static void stored_block(image_writer * w, size_t len, bool last){
+    unsigned char header[5];
+    header[0] = last;
+    header[1] = len & 0xff;
+    header[2] = len >> 8;
+    header[3] = ~len & 0xff;
+    header[4] = (~len >> 8) & 0xff;
+    chunk_bytes(w, header, 5);
+}
+
+/*one IDAT chunk carrying count rows as stored blocks, the first chunk
+ * also starts the zlib stream*/
+static void write_png_rows(image_writer * w, const color * rows, int count, int stride){
+    static const unsigned char zlib_header[2] = {0x78, 0x01};
+    size_t row_len = 3 * (size_t)w->width + 1, raw_len = row_len * count;
+    size_t blocks = (raw_len + 65534) / 65535, left = 0, done = 0, pos, n;
+    unsigned char buf[4];
+    int i;
+
+    put_u32(buf, (w->rows == 0 ? 2 : 0) + raw_len + 5 * blocks);
+    fwrite(buf, 1, 4, w->f);
+    w->crc = 0xffffffffu;
+    chunk_bytes(w, "IDAT", 4);
+    if(w->rows == 0){
+        chunk_bytes(w, zlib_header, 2);
+    }
+
+    for(i = count - 1; i >= 0; --i){
+        /*filter type 0 (none) followed by the RGB bytes*/
+        w->row[0] = 0;
+        pack_row(w->row + 1, rows + (size_t)i * stride, w->width);
+        for(pos = 0; pos < row_len; ++pos){
+            w->adler_a = (w->adler_a + w->row[pos]) % 65521;
+            w->adler_b = (w->adler_b + w->adler_a) % 65521;
+        }
+        /*blocks hold up to 65535 bytes and may split a row*/
+        for(pos = 0; pos < row_len; pos += n){
+            if(left == 0){
+                left = raw_len - done < 65535 ? raw_len - done : 65535;
+                stored_block(w, left, false);
+            }
+            n = row_len - pos < left ? row_len - pos : left;
+            chunk_bytes(w, w->row + pos, n);
+            left -= n;
+            done += n;
+        }
+    }
+    put_u32(buf, w->crc ^ 0xffffffffu);
+    fwrite(buf, 1, 4, w->f);
+}
+
+bool open_image(image_writer * w, const char * path, int width, int height){
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    const char * ext = strrchr(path, '.');
+    unsigned char header[13];
+
+    w->png = ext != NULL && strcmp(ext, ".png") == 0;
+    w->width = width;
+    w->height = height;
+    w->rows = 0;
+    w->adler_a = 1;
+    w->adler_b = 0;
+    w->row = malloc(3 * (size_t)width + 1);
+    w->f = w->row != NULL ? fopen(path, "wb") : NULL;
+    if(w->f == NULL){
+        free(w->row);
+        return false;
+    }
+
+    if(!w->png){
+        fprintf(w->f, "P6\n%d %d\n255\n", width, height);
+        return true;
+    }
+    init_crc_table();
+    put_u32(header, width);
+    put_u32(header + 4, height);
+    header[8] = 8;      /*bit depth*/
+    header[9] = 2;      /*truecolor*/
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    fwrite(signature, 1, 8, w->f);
+    write_chunk(w->f, "IHDR", header, 13);
+    return true;
+}
+
+bool write_rows(image_writer * w, const color * rows, int count, int stride){
+    int i;
+
+    if(count <= 0 || w->rows + count > w->height){
+        return false;
+    }
+    if(w->png){
+        write_png_rows(w, rows, count, stride);
+    } else {
+        for(i = count - 1; i >= 0; --i){
+            pack_row(w->row, rows + (size_t)i * stride, w->width);
+            fwrite(w->row, 3, w->width, w->f);
+        }
+    }
+    w->rows += count;
+    return !ferror(w->f);
+}
+
+bool close_image(image_writer * w){
+    unsigned char end[9];
+    bool ok = w->rows == w->height;
+
+    if(w->png){
+        /*an empty last block ends the deflate data, then the checksum*/
+        end[0] = 1;
+        end[1] = 0;
+        end[2] = 0;
+        end[3] = 0xff;
+        end[4] = 0xff;
+        put_u32(end + 5, (w->adler_b << 16) | w->adler_a);
+        write_chunk(w->f, "IDAT", end, 9);
+        write_chunk(w->f, "IEND", NULL, 0);
+    }
+    ok = ok && !ferror(w->f);
+    free(w->row);
+    return fclose(w->f) == 0 && ok;
+}
+
+bool write_image(const char * path, const color * pixels, int width, int height,
+        int stride){
+    image_writer w;
+    bool ok;
+
+    if(!open_image(&w, path, width, height)){
+        return false;
+    }
+    ok = write_rows(&w, pixels, height, stride);
+    return close_image(&w) && ok;
+}
+
+/*reads the 8 bit binary PPM at path, returning its RGB bytes top row
+ * first (malloc'd) and its size, or NULL if it cannot*/
+unsigned char * read_ppm(const char * path, int * width, int * height){
+    unsigned char * bytes = NULL;
+    int max_value;
+    size_t size;
+    FILE * f = fopen(path, "rb");
+
+    if(f == NULL){
+        return NULL;
+    }
+    /*the single whitespace after the header is read by the %*c*/
+    if(fscanf(f, "P6 %d %d %d%*c", width, height, &max_value) == 3
+            && *width > 0 && *height > 0 && max_value == 255){
+        size = 3 * (size_t)*width * *height;
+        bytes = malloc(size);
+        if(bytes != NULL && fread(bytes, 1, size, f) != size){
+            free(bytes);
+            bytes = NULL;
+        }
+    }
+    fclose(f);
+    return bytes;
+}
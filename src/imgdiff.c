@@ -0,0 +1,60 @@
+/*********************
+ * Image comparison for checking one build's renders against another's:
+ * reports how far apart two PPM images are and fails when too many
+ * pixels differ.
+ *
+ * A pixel differs when any of its channels is more than the threshold
+ * apart; a few are expected where a ray grazes a sphere's edge and
+ * rounding decides whether it hits.
+ */
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char ** argv){
+    unsigned char * a, * b;
+    int wa, ha, wb, hb, threshold, i, c, d, max_diff = 0;
+    long differ = 0, pixels;
+    double sum = 0, max_share, share;
+    char * end;
+
+    if(argc != 5){
+        fprintf(stderr, "usage: %s a.ppm b.ppm threshold max_share\n"
+                "  fails if more than max_share of the pixels differ by more\n"
+                "  than threshold (0-255) in some channel\n", argv[0]);
+        return 2;
+    }
+    threshold = (int)strtol(argv[3], &end, 10);
+    max_share = strtod(argv[4], &end);
+
+    a = read_ppm(argv[1], &wa, &ha);
+    b = read_ppm(argv[2], &wb, &hb);
+    if(a == NULL || b == NULL){
+        fprintf(stderr, "%s: cannot read %s\n", argv[0], a == NULL ? argv[1] : argv[2]);
+        return 2;
+    }
+    if(wa != wb || ha != hb){
+        fprintf(stderr, "%s: %dx%d and %dx%d images\n", argv[0], wa, ha, wb, hb);
+        return 1;
+    }
+
+    pixels = (long)wa * ha;
+    for(i = 0; i < pixels; ++i){
+        int worst = 0;
+        for(c = 0; c < 3; ++c){
+            d = abs(a[3*i + c] - b[3*i + c]);
+            sum += d;
+            worst = d > worst ? d : worst;
+        }
+        max_diff = worst > max_diff ? worst : max_diff;
+        differ += worst > threshold;
+    }
+    share = differ / (double)pixels;
+    printf("mean channel difference %.4f, largest %d, %ld pixels (%.3f%%) differ by more "
+           "than %d\n", sum / (3.0 * pixels), max_diff, differ, 100 * share, threshold);
+
+    free(a);
+    free(b);
+    return share <= max_share ? 0 : 1;
+}
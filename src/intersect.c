@@ -0,0 +1,334 @@
+/*********************
+ * Structure of arrays ray/sphere intersection kernels.
+ *
+ * Every kernel follows the same rule: no hit when the ray starts inside
+ * the sphere or only grazes it, and the nearest root past HIT_EPSILON
+ * otherwise. Only the distance t is computed, the caller finds the point
+ * and normal of the one hit it keeps.
+ *
+ * nearest_scalar - one sphere at a time
+ * nearest_sse2 - two spheres per instruction, four in a float build
+ * nearest_avx2 - four spheres per instruction, eight in a float build
+ * select_kernel - picks a kernel by name or from the cpu features
+ */
+#include "intersect.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+void alloc_sphere_soa(sphere_soa * s, int count){
+    size_t n = count + SOA_PADDING;
+    s->cx = calloc(n, sizeof(real));
+    s->cy = calloc(n, sizeof(real));
+    s->cz = calloc(n, sizeof(real));
+    s->r2 = calloc(n, sizeof(real));
+    s->material = calloc(n, sizeof(int));
+    s->count = count;
+}
+
+void free_sphere_soa(sphere_soa * s){
+    free(s->cx);
+    free(s->cy);
+    free(s->cz);
+    free(s->r2);
+    free(s->material);
+    memset(s, 0, sizeof(sphere_soa));
+}
+
+void set_soa_sphere(sphere_soa * s, int i, sphere sph, int material){
+    s->cx[i] = sph.center.x;
+    s->cy[i] = sph.center.y;
+    s->cz[i] = sph.center.z;
+    s->r2[i] = sph.radius * sph.radius;
+    s->material[i] = material;
+}
+
+static int nearest_scalar(const sphere_soa * s, int first, int count, ray r, real * t){
+    int i, found = -1;
+    real dx = r.at.x - r.orgin.x, dy = r.at.y - r.orgin.y, dz = r.at.z - r.orgin.z;
+    real a = dx*dx + dy*dy + dz*dz, best = *t;
+
+    for(i = first; i < first + count; ++i){
+        real ox = r.orgin.x - s->cx[i], oy = r.orgin.y - s->cy[i], oz = r.orgin.z - s->cz[i];
+        real c = ox*ox + oy*oy + oz*oz - s->r2[i];
+        real b = 2 * (ox*dx + oy*dy + oz*dz);
+        real disc = b*b - 4*a*c, sq, t0, t1, hit;
+
+        /*c < 0 means the ray starts inside the sphere*/
+        if(c < 0 || disc <= HIT_EPSILON){
+            continue;
+        }
+        sq = real_sqrt(disc);
+        t0 = (-b - sq) / (2 * a);
+        t1 = (-b + sq) / (2 * a);
+        hit = t0 > HIT_EPSILON ? t0 : t1;
+        if(t1 >= HIT_EPSILON && hit < best){
+            best = hit;
+            found = i;
+        }
+    }
+    *t = best;
+    return found;
+}
+
+#if defined(HAVE_X86_KERNELS) && !defined(RAYFOO_FLOAT)
+
+__attribute__((target("sse2")))
+static int nearest_sse2(const sphere_soa * s, int first, int count, ray r, double * t){
+    int i, lane, found = -1;
+    double dx = r.at.x - r.orgin.x, dy = r.at.y - r.orgin.y, dz = r.at.z - r.orgin.z;
+    double a = dx*dx + dy*dy + dz*dz;
+    double best_t[2], best_i[2];
+    __m128d vdx = _mm_set1_pd(dx), vdy = _mm_set1_pd(dy), vdz = _mm_set1_pd(dz);
+    __m128d vox = _mm_set1_pd(r.orgin.x), voy = _mm_set1_pd(r.orgin.y),
+            voz = _mm_set1_pd(r.orgin.z);
+    __m128d va4 = _mm_set1_pd(4.0 * a), va2 = _mm_set1_pd(2 * a);
+    __m128d two = _mm_set1_pd(2.0), zero = _mm_setzero_pd();
+    __m128d eps = _mm_set1_pd(HIT_EPSILON);
+    __m128d best = _mm_set1_pd(*t), best_idx = _mm_set1_pd(-1);
+    __m128d idx = _mm_set_pd(first + 1, first), step = _mm_set1_pd(2);
+    __m128d end = _mm_set1_pd(first + count);
+
+    for(i = first; i < first + count; i += 2){
+        __m128d ox = _mm_sub_pd(vox, _mm_loadu_pd(s->cx + i));
+        __m128d oy = _mm_sub_pd(voy, _mm_loadu_pd(s->cy + i));
+        __m128d oz = _mm_sub_pd(voz, _mm_loadu_pd(s->cz + i));
+        __m128d c = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(ox, ox), _mm_mul_pd(oy, oy)),
+                        _mm_mul_pd(oz, oz)), _mm_loadu_pd(s->r2 + i));
+        __m128d b = _mm_mul_pd(two, _mm_add_pd(_mm_add_pd(_mm_mul_pd(ox, vdx),
+                        _mm_mul_pd(oy, vdy)), _mm_mul_pd(oz, vdz)));
+        __m128d disc = _mm_sub_pd(_mm_mul_pd(b, b), _mm_mul_pd(va4, c));
+        __m128d sq = _mm_sqrt_pd(_mm_max_pd(disc, zero));
+        __m128d nb = _mm_sub_pd(zero, b);
+        __m128d t0 = _mm_div_pd(_mm_sub_pd(nb, sq), va2);
+        __m128d t1 = _mm_div_pd(_mm_add_pd(nb, sq), va2);
+        __m128d use0 = _mm_cmpgt_pd(t0, eps);
+        __m128d hit = _mm_or_pd(_mm_and_pd(use0, t0), _mm_andnot_pd(use0, t1));
+        __m128d mask = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(c, zero), _mm_cmpgt_pd(disc, eps)),
+                        _mm_and_pd(_mm_cmpge_pd(t1, eps), _mm_cmplt_pd(hit, best)));
+        mask = _mm_and_pd(mask, _mm_cmplt_pd(idx, end));
+        best = _mm_or_pd(_mm_and_pd(mask, hit), _mm_andnot_pd(mask, best));
+        best_idx = _mm_or_pd(_mm_and_pd(mask, idx), _mm_andnot_pd(mask, best_idx));
+        idx = _mm_add_pd(idx, step);
+    }
+
+    _mm_storeu_pd(best_t, best);
+    _mm_storeu_pd(best_i, best_idx);
+    for(lane = 0; lane < 2; ++lane){
+        if(best_i[lane] >= 0 && (best_t[lane] < *t
+                || (best_t[lane] == *t && found >= 0 && best_i[lane] < found))){
+            *t = best_t[lane];
+            found = (int)best_i[lane];
+        }
+    }
+    return found;
+}
+
+__attribute__((target("avx2")))
+static int nearest_avx2(const sphere_soa * s, int first, int count, ray r, double * t){
+    int i, lane, found = -1;
+    double dx = r.at.x - r.orgin.x, dy = r.at.y - r.orgin.y, dz = r.at.z - r.orgin.z;
+    double a = dx*dx + dy*dy + dz*dz;
+    double best_t[4], best_i[4];
+    __m256d vdx = _mm256_set1_pd(dx), vdy = _mm256_set1_pd(dy), vdz = _mm256_set1_pd(dz);
+    __m256d vox = _mm256_set1_pd(r.orgin.x), voy = _mm256_set1_pd(r.orgin.y),
+            voz = _mm256_set1_pd(r.orgin.z);
+    __m256d va4 = _mm256_set1_pd(4.0 * a), va2 = _mm256_set1_pd(2 * a);
+    __m256d two = _mm256_set1_pd(2.0), zero = _mm256_setzero_pd();
+    __m256d eps = _mm256_set1_pd(HIT_EPSILON);
+    __m256d best = _mm256_set1_pd(*t), best_idx = _mm256_set1_pd(-1);
+    __m256d idx = _mm256_set_pd(first + 3, first + 2, first + 1, first),
+            step = _mm256_set1_pd(4);
+    __m256d end = _mm256_set1_pd(first + count);
+
+    for(i = first; i < first + count; i += 4){
+        __m256d ox = _mm256_sub_pd(vox, _mm256_loadu_pd(s->cx + i));
+        __m256d oy = _mm256_sub_pd(voy, _mm256_loadu_pd(s->cy + i));
+        __m256d oz = _mm256_sub_pd(voz, _mm256_loadu_pd(s->cz + i));
+        __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ox, ox),
+                        _mm256_mul_pd(oy, oy)), _mm256_mul_pd(oz, oz)),
+                        _mm256_loadu_pd(s->r2 + i));
+        __m256d b = _mm256_mul_pd(two, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ox, vdx),
+                        _mm256_mul_pd(oy, vdy)), _mm256_mul_pd(oz, vdz)));
+        __m256d disc = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(va4, c));
+        __m256d sq = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+        __m256d nb = _mm256_sub_pd(zero, b);
+        __m256d t0 = _mm256_div_pd(_mm256_sub_pd(nb, sq), va2);
+        __m256d t1 = _mm256_div_pd(_mm256_add_pd(nb, sq), va2);
+        __m256d hit = _mm256_blendv_pd(t1, t0, _mm256_cmp_pd(t0, eps, _CMP_GT_OQ));
+        __m256d mask = _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(c, zero, _CMP_GE_OQ),
+                              _mm256_cmp_pd(disc, eps, _CMP_GT_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(t1, eps, _CMP_GE_OQ),
+                              _mm256_cmp_pd(hit, best, _CMP_LT_OQ)));
+        mask = _mm256_and_pd(mask, _mm256_cmp_pd(idx, end, _CMP_LT_OQ));
+        best = _mm256_blendv_pd(best, hit, mask);
+        best_idx = _mm256_blendv_pd(best_idx, idx, mask);
+        idx = _mm256_add_pd(idx, step);
+    }
+
+    _mm256_storeu_pd(best_t, best);
+    _mm256_storeu_pd(best_i, best_idx);
+    for(lane = 0; lane < 4; ++lane){
+        if(best_i[lane] >= 0 && (best_t[lane] < *t
+                || (best_t[lane] == *t && found >= 0 && best_i[lane] < found))){
+            *t = best_t[lane];
+            found = (int)best_i[lane];
+        }
+    }
+    return found;
+}
+
+#elif defined(HAVE_X86_KERNELS)
+
+/*the float kernels keep the sphere indices in integer lanes, a float
+ * only counts exactly to 2^24*/
+
+__attribute__((target("sse2")))
+static int nearest_sse2(const sphere_soa * s, int first, int count, ray r, float * t){
+    int i, lane, found = -1;
+    float dx = r.at.x - r.orgin.x, dy = r.at.y - r.orgin.y, dz = r.at.z - r.orgin.z;
+    float a = dx*dx + dy*dy + dz*dz;
+    float best_t[4];
+    int best_i[4];
+    __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy), vdz = _mm_set1_ps(dz);
+    __m128 vox = _mm_set1_ps(r.orgin.x), voy = _mm_set1_ps(r.orgin.y),
+           voz = _mm_set1_ps(r.orgin.z);
+    __m128 va4 = _mm_set1_ps(4 * a), va2 = _mm_set1_ps(2 * a);
+    __m128 two = _mm_set1_ps(2), zero = _mm_setzero_ps();
+    __m128 eps = _mm_set1_ps(HIT_EPSILON);
+    __m128 best = _mm_set1_ps(*t);
+    __m128i best_idx = _mm_set1_epi32(-1);
+    __m128i idx = _mm_set_epi32(first + 3, first + 2, first + 1, first),
+            step = _mm_set1_epi32(4);
+    __m128i end = _mm_set1_epi32(first + count);
+
+    for(i = first; i < first + count; i += 4){
+        __m128 ox = _mm_sub_ps(vox, _mm_loadu_ps(s->cx + i));
+        __m128 oy = _mm_sub_ps(voy, _mm_loadu_ps(s->cy + i));
+        __m128 oz = _mm_sub_ps(voz, _mm_loadu_ps(s->cz + i));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)),
+                        _mm_mul_ps(oz, oz)), _mm_loadu_ps(s->r2 + i));
+        __m128 b = _mm_mul_ps(two, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, vdx),
+                        _mm_mul_ps(oy, vdy)), _mm_mul_ps(oz, vdz)));
+        __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(va4, c));
+        __m128 sq = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+        __m128 nb = _mm_sub_ps(zero, b);
+        __m128 t0 = _mm_div_ps(_mm_sub_ps(nb, sq), va2);
+        __m128 t1 = _mm_div_ps(_mm_add_ps(nb, sq), va2);
+        __m128 use0 = _mm_cmpgt_ps(t0, eps);
+        __m128 hit = _mm_or_ps(_mm_and_ps(use0, t0), _mm_andnot_ps(use0, t1));
+        __m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(c, zero), _mm_cmpgt_ps(disc, eps)),
+                        _mm_and_ps(_mm_cmpge_ps(t1, eps), _mm_cmplt_ps(hit, best)));
+        __m128i imask;
+        mask = _mm_and_ps(mask, _mm_castsi128_ps(_mm_cmplt_epi32(idx, end)));
+        imask = _mm_castps_si128(mask);
+        best = _mm_or_ps(_mm_and_ps(mask, hit), _mm_andnot_ps(mask, best));
+        best_idx = _mm_or_si128(_mm_and_si128(imask, idx), _mm_andnot_si128(imask, best_idx));
+        idx = _mm_add_epi32(idx, step);
+    }
+
+    _mm_storeu_ps(best_t, best);
+    _mm_storeu_si128((__m128i *)best_i, best_idx);
+    for(lane = 0; lane < 4; ++lane){
+        if(best_i[lane] >= 0 && (best_t[lane] < *t
+                || (best_t[lane] == *t && found >= 0 && best_i[lane] < found))){
+            *t = best_t[lane];
+            found = best_i[lane];
+        }
+    }
+    return found;
+}
+
+__attribute__((target("avx2")))
+static int nearest_avx2(const sphere_soa * s, int first, int count, ray r, float * t){
+    int i, lane, found = -1;
+    float dx = r.at.x - r.orgin.x, dy = r.at.y - r.orgin.y, dz = r.at.z - r.orgin.z;
+    float a = dx*dx + dy*dy + dz*dz;
+    float best_t[8];
+    int best_i[8];
+    __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy), vdz = _mm256_set1_ps(dz);
+    __m256 vox = _mm256_set1_ps(r.orgin.x), voy = _mm256_set1_ps(r.orgin.y),
+           voz = _mm256_set1_ps(r.orgin.z);
+    __m256 va4 = _mm256_set1_ps(4 * a), va2 = _mm256_set1_ps(2 * a);
+    __m256 two = _mm256_set1_ps(2), zero = _mm256_setzero_ps();
+    __m256 eps = _mm256_set1_ps(HIT_EPSILON);
+    __m256 best = _mm256_set1_ps(*t);
+    __m256i best_idx = _mm256_set1_epi32(-1);
+    __m256i idx = _mm256_setr_epi32(first, first + 1, first + 2, first + 3,
+                        first + 4, first + 5, first + 6, first + 7),
+            step = _mm256_set1_epi32(8);
+    __m256i end = _mm256_set1_epi32(first + count);
+
+    for(i = first; i < first + count; i += 8){
+        __m256 ox = _mm256_sub_ps(vox, _mm256_loadu_ps(s->cx + i));
+        __m256 oy = _mm256_sub_ps(voy, _mm256_loadu_ps(s->cy + i));
+        __m256 oz = _mm256_sub_ps(voz, _mm256_loadu_ps(s->cz + i));
+        __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox),
+                        _mm256_mul_ps(oy, oy)), _mm256_mul_ps(oz, oz)),
+                        _mm256_loadu_ps(s->r2 + i));
+        __m256 b = _mm256_mul_ps(two, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, vdx),
+                        _mm256_mul_ps(oy, vdy)), _mm256_mul_ps(oz, vdz)));
+        __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(va4, c));
+        __m256 sq = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+        __m256 nb = _mm256_sub_ps(zero, b);
+        __m256 t0 = _mm256_div_ps(_mm256_sub_ps(nb, sq), va2);
+        __m256 t1 = _mm256_div_ps(_mm256_add_ps(nb, sq), va2);
+        __m256 hit = _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, eps, _CMP_GT_OQ));
+        __m256 mask = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(c, zero, _CMP_GE_OQ),
+                              _mm256_cmp_ps(disc, eps, _CMP_GT_OQ)),
+                _mm256_and_ps(_mm256_cmp_ps(t1, eps, _CMP_GE_OQ),
+                              _mm256_cmp_ps(hit, best, _CMP_LT_OQ)));
+        mask = _mm256_and_ps(mask, _mm256_castsi256_ps(_mm256_cmpgt_epi32(end, idx)));
+        best = _mm256_blendv_ps(best, hit, mask);
+        best_idx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best_idx),
+                        _mm256_castsi256_ps(idx), mask));
+        idx = _mm256_add_epi32(idx, step);
+    }
+
+    _mm256_storeu_ps(best_t, best);
+    _mm256_storeu_si256((__m256i *)best_i, best_idx);
+    for(lane = 0; lane < 8; ++lane){
+        if(best_i[lane] >= 0 && (best_t[lane] < *t
+                || (best_t[lane] == *t && found >= 0 && best_i[lane] < found))){
+            *t = best_t[lane];
+            found = best_i[lane];
+        }
+    }
+    return found;
+}
+
+#endif
+
+nearest_sphere_fn nearest_sphere = nearest_scalar;
+
+/*picks the kernel called name ("scalar", "sse2" or "avx2"), or the widest
+ * one the cpu runs when name is NULL. Returns the name of the kernel in
+ * use, or NULL if the requested one is unknown or unsupported*/
+const char * select_kernel(const char * name){
+#ifdef HAVE_X86_KERNELS
+    bool avx2 = __builtin_cpu_supports("avx2");
+    if(name == NULL){
+        name = avx2 ? "avx2" : "sse2";
+    }
+    if(strcmp(name, "avx2") == 0 && avx2){
+        nearest_sphere = nearest_avx2;
+        return "avx2";
+    }
+    if(strcmp(name, "sse2") == 0){
+        nearest_sphere = nearest_sse2;
+        return "sse2";
+    }
+#endif
+    if(name == NULL || strcmp(name, "scalar") == 0){
+        nearest_sphere = nearest_scalar;
+        return "scalar";
+    }
+    return NULL;
+}
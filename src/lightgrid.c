@@ -0,0 +1,130 @@
+/*********************
+ * Grid of the point lights' reach.
+ *
+ * build_light_grid - sizes the grid to the lights and lists each cell's
+ *                  lights
+ * overlaps - whether a light's sphere of reach touches a cell
+ */
+#include "lightgrid.h"
+#include "scene.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*cells along an axis of the given extent with cells of edge*/
+static int grid_dim(double extent, double edge){
+    double n = ceil(extent / edge);
+    return !(n >= 1) ? 1 : n > GRID_MAX_DIM ? GRID_MAX_DIM : (int)n;
+}
+
+/*whether the sphere of reach of pl touches the cell x, y, z*/
+static bool overlaps(const light_grid * grid, const point_light * pl, int x, int y, int z){
+    double lo, hi, d, dist = 0;
+    double c[3] = {pl->l.location.x, pl->l.location.y, pl->l.location.z};
+    double m[3] = {grid->min.x, grid->min.y, grid->min.z};
+    double inv[3] = {grid->inv_cell.x, grid->inv_cell.y, grid->inv_cell.z};
+    int cell[3] = {x, y, z}, k;
+
+    /*squared distance from the light to the cell's box*/
+    for(k = 0; k < 3; ++k){
+        lo = m[k] + cell[k] / inv[k];
+        hi = m[k] + (cell[k] + 1) / inv[k];
+        d = c[k] < lo ? lo - c[k] : c[k] > hi ? c[k] - hi : 0;
+        dist += d * d;
+    }
+    return dist <= pl->radius * pl->radius;
+}
+
+/*the range of cells [*lo, *hi] along an axis that [a, b] covers*/
+static void cell_range(double a, double b, double min, double inv, int n, int * lo, int * hi){
+    *lo = (int)((a - min) * inv);
+    *hi = (int)((b - min) * inv);
+    *lo = *lo < 0 ? 0 : *lo >= n ? n - 1 : *lo;
+    *hi = *hi < 0 ? 0 : *hi >= n ? n - 1 : *hi;
+}
+
+/*builds the grid over the count lights, replacing any previous grid. The
+ * lights are counted into their cells once, then listed in a second pass
+ * over the same cells*/
+void build_light_grid(light_grid * grid, const point_light * lights, int count){
+    point max;
+    double volume, edge, ex, ey, ez;
+    int i, pass, x, y, z, cells, x0, x1, y0, y1, z0, z1;
+
+    free_light_grid(grid);
+    if(count == 0){
+        return;
+    }
+
+    grid->min.x = grid->min.y = grid->min.z = REAL_MAX;
+    max.x = max.y = max.z = -REAL_MAX;
+    for(i = 0; i < count; ++i){
+        const point * c = &lights[i].l.location;
+        double r = lights[i].radius;
+        grid->min.x = real_min(grid->min.x, c->x - r);
+        grid->min.y = real_min(grid->min.y, c->y - r);
+        grid->min.z = real_min(grid->min.z, c->z - r);
+        max.x = real_max(max.x, c->x + r);
+        max.y = real_max(max.y, c->y + r);
+        max.z = real_max(max.z, c->z + r);
+    }
+
+    /*a reach too small to tell apart from its light's coordinates would
+     * leave an extent (and edge) of 0 and cells of infinite density*/
+    ex = fmax(max.x - grid->min.x, GRID_MIN_EXTENT);
+    ey = fmax(max.y - grid->min.y, GRID_MIN_EXTENT);
+    ez = fmax(max.z - grid->min.z, GRID_MIN_EXTENT);
+    volume = ex * ey * ez;
+    edge = fmax(cbrt(volume / ((double)count * GRID_CELLS_PER_LIGHT)), GRID_MIN_EXTENT);
+    grid->nx = grid_dim(ex, edge);
+    grid->ny = grid_dim(ey, edge);
+    grid->nz = grid_dim(ez, edge);
+    grid->inv_cell.x = grid->nx / ex;
+    grid->inv_cell.y = grid->ny / ey;
+    grid->inv_cell.z = grid->nz / ez;
+    cells = grid->nx * grid->ny * grid->nz;
+    grid->first = calloc(cells + 1, sizeof(int));
+
+    for(pass = 0; pass < 2; ++pass){
+        for(i = 0; i < count; ++i){
+            const point * c = &lights[i].l.location;
+            double r = lights[i].radius;
+            cell_range(c->x - r, c->x + r, grid->min.x, grid->inv_cell.x, grid->nx, &x0, &x1);
+            cell_range(c->y - r, c->y + r, grid->min.y, grid->inv_cell.y, grid->ny, &y0, &y1);
+            cell_range(c->z - r, c->z + r, grid->min.z, grid->inv_cell.z, grid->nz, &z0, &z1);
+            for(z = z0; z <= z1; ++z){
+                for(y = y0; y <= y1; ++y){
+                    for(x = x0; x <= x1; ++x){
+                        int cell = (z * grid->ny + y) * grid->nx + x;
+                        if(!overlaps(grid, &lights[i], x, y, z)){
+                            continue;
+                        }
+                        if(pass == 0){
+                            ++grid->first[cell + 1];
+                        } else {
+                            grid->lights[grid->first[cell]++] = i;
+                        }
+                    }
+                }
+            }
+        }
+        if(pass == 0){
+            /*counts to the start of each cell's list*/
+            for(i = 0; i < cells; ++i){
+                grid->first[i + 1] += grid->first[i];
+            }
+            grid->entries = grid->first[cells];
+            grid->lights = malloc(sizeof(int) * (grid->entries > 0 ? grid->entries : 1));
+        }
+    }
+    /*the listing pass moved each start to the next cell's*/
+    memmove(grid->first + 1, grid->first, sizeof(int) * cells);
+    grid->first[0] = 0;
+}
+
+void free_light_grid(light_grid * grid){
+    free(grid->first);
+    free(grid->lights);
+    memset(grid, 0, sizeof(light_grid));
+}
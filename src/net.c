@@ -0,0 +1,139 @@
+/*********************
+ * Sockets shared by the render farm and the render server.
+ *
+ * open_address - a listening or connected socket for an address
+ * close_address - closes a listening socket, removing its socket file
+ * read_all, write_all - move a whole buffer over a stream socket
+ */
+#include "net.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*a socket listening on address, or connected to it; -1 with errno set
+ * when that fails, or with errno 0 and a message for a bad address*/
+int open_address(const char * address, bool listening){
+    struct addrinfo hints, * found, * ai;
+    struct sockaddr_un un;
+    const char * colon;
+    char host[256];
+    int fd = -1, one = 1, error;
+
+    if(strncmp(address, "unix:", 5) == 0){
+        if(strlen(address + 5) >= sizeof(un.sun_path)){
+            fprintf(stderr, "%s: socket path too long\n", address);
+            errno = 0;
+            return -1;
+        }
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        strcpy(un.sun_path, address + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0){
+            return -1;
+        }
+        if(listening){
+            unlink(un.sun_path);
+        }
+        if(listening ? bind(fd, (struct sockaddr *)&un, sizeof(un)) == 0
+                    && listen(fd, LISTEN_BACKLOG) == 0
+                : connect(fd, (struct sockaddr *)&un, sizeof(un)) == 0){
+            return fd;
+        }
+        error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    colon = strrchr(address, ':');
+    if(colon == NULL || colon[1] == '\0' || colon - address >= (int)sizeof(host)){
+        fprintf(stderr, "%s: expected unix:PATH or HOST:PORT\n", address);
+        errno = 0;
+        return -1;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    error = getaddrinfo(host[0] != '\0' ? host : NULL, colon + 1, &hints, &found);
+    if(error != 0){
+        fprintf(stderr, "%s: %s\n", address, gai_strerror(error));
+        errno = 0;
+        return -1;
+    }
+    for(ai = found; ai != NULL; ai = ai->ai_next){
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd < 0){
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if(listening){
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if(listening ? bind(fd, ai->ai_addr, ai->ai_addrlen) == 0
+                    && listen(fd, LISTEN_BACKLOG) == 0
+                : connect(fd, ai->ai_addr, ai->ai_addrlen) == 0){
+            break;
+        }
+        error = errno;
+        close(fd);
+        errno = error;
+        fd = -1;
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+/*closes fd, listening on address, and removes the socket file of a
+ * unix: address so the next listener can bind it*/
+void close_address(int fd, const char * address){
+    close(fd);
+    if(strncmp(address, "unix:", 5) == 0){
+        unlink(address + 5);
+    }
+}
+
+bool read_all(int fd, void * data, size_t size){
+    char * p = data;
+    ssize_t n;
+    while(size > 0){
+        n = recv(fd, p, size, 0);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+/*without SIGPIPE, a peer that went away is an error like any other*/
+bool write_all(int fd, const void * data, size_t size){
+    const char * p = data;
+    ssize_t n;
+    while(size > 0){
+        n = send(fd, p, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
@@ -0,0 +1,329 @@
+/*********************
+ * Command line parsing for rayfoo and rayfoo-headless.
+ */
+#include "options.h"
+#include "bvh.h"
+#include "scene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void default_options(render_options * opts){
+    opts->headless = false;
+    opts->output = "rayfoo.ppm";
+    opts->stream = false;
+    opts->scene_file = NULL;
+    opts->width = DEFAULT_WIDTH;
+    opts->height = DEFAULT_HEIGHT;
+    opts->extent_width = opts->extent_height = 0;
+    opts->threads = 0;
+    opts->tile_size = 0;
+    opts->use_bvh = true;
+    opts->shadows = true;
+    opts->occluder_cache = true;
+    opts->use_light_grid = true;
+    opts->kernel = NULL;
+    opts->packet_size = 4;
+    opts->wavefront = false;
+    opts->max_depth = 5;
+    opts->min_weight = DEFAULT_MIN_WEIGHT;
+    opts->roulette = false;
+    opts->aa = 1;
+    opts->hit_cache = false;
+    opts->stats = false;
+    opts->stats_json = false;
+    opts->spline_u = 20;
+    opts->spline_v = 10;
+    opts->serve = NULL;
+    opts->farm = NULL;
+    opts->worker = NULL;
+    opts->farm_timeout = DEFAULT_FARM_TIMEOUT;
+    opts->drop_after = 0;
+    opts->stall_after = 0;
+}
+
+/*reads the integer argument following option i*/
+static bool int_argument(int argc, char ** argv, int * i, int * value){
+    char * end;
+    if(*i + 1 >= argc){
+        fprintf(stderr, "%s: missing number after %s\n", argv[0], argv[*i]);
+        return false;
+    }
+    ++*i;
+    *value = (int)strtol(argv[*i], &end, 10);
+    if(*end != '\0' || *value < 0){
+        fprintf(stderr, "%s: bad number %s for %s\n", argv[0], argv[*i], argv[*i-1]);
+        return false;
+    }
+    return true;
+}
+
+/*reads the non negative number argument following option i*/
+static bool double_argument(int argc, char ** argv, int * i, double * value){
+    char * end;
+    if(*i + 1 >= argc){
+        fprintf(stderr, "%s: missing number after %s\n", argv[0], argv[*i]);
+        return false;
+    }
+    ++*i;
+    *value = strtod(argv[*i], &end);
+    if(*end != '\0' || *value < 0){
+        fprintf(stderr, "%s: bad number %s for %s\n", argv[0], argv[*i], argv[*i-1]);
+        return false;
+    }
+    return true;
+}
+
+/*reads the WxH argument following option i, both positive and finite*/
+static bool size_argument(int argc, char ** argv, int * i, double * width, double * height){
+    char * end;
+    if(*i + 1 >= argc){
+        fprintf(stderr, "%s: missing size after %s\n", argv[0], argv[*i]);
+        return false;
+    }
+    ++*i;
+    *width = strtod(argv[*i], &end);
+    if(*end == 'x'){
+        *height = strtod(end + 1, &end);
+    }
+    if(*end != '\0' || !(*width > 0 && isfinite(*width))
+            || !(*height > 0 && isfinite(*height))){
+        fprintf(stderr, "%s: bad size %s for %s, expected WxH\n", argv[0], argv[*i],
+                argv[*i-1]);
+        return false;
+    }
+    return true;
+}
+
+/*parses argv into opts, unknown arguments are skipped when allow_unknown
+ * is set (so GLUT can see its own), otherwise they are an error*/
+bool parse_options(int argc, char ** argv, render_options * opts, bool allow_unknown){
+    int i;
+    for(i = 1; i < argc; ++i){
+        if(strcmp(argv[i], "--headless") == 0){
+            opts->headless = true;
+        } else if(strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0){
+            if(++i >= argc){
+                fprintf(stderr, "%s: missing file name after %s\n", argv[0], argv[i-1]);
+                return false;
+            }
+            opts->output = argv[i];
+        } else if(strcmp(argv[i], "--stream") == 0){
+            opts->stream = true;
+        } else if(strcmp(argv[i], "--scene") == 0){
+            if(++i >= argc){
+                fprintf(stderr, "%s: missing file name after %s\n", argv[0], argv[i-1]);
+                return false;
+            }
+            opts->scene_file = argv[i];
+        } else if(strcmp(argv[i], "--size") == 0){
+            double w = 0, h = 0;
+            if(!size_argument(argc, argv, &i, &w, &h)){
+                return false;
+            }
+            /*bounded first, converting a double an int cannot hold is
+             * undefined*/
+            if(w > MAX_PIXELS || h > MAX_PIXELS || w != (int)w || h != (int)h
+                    || w * h > MAX_PIXELS){
+                fprintf(stderr, "%s: --size takes whole pixels, at most %d in all\n",
+                        argv[0], MAX_PIXELS);
+                return false;
+            }
+            opts->width = (int)w;
+            opts->height = (int)h;
+        } else if(strcmp(argv[i], "--extent") == 0){
+            if(!size_argument(argc, argv, &i, &opts->extent_width, &opts->extent_height)){
+                return false;
+            }
+        } else if(strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0){
+            if(!int_argument(argc, argv, &i, &opts->threads)){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--tile") == 0){
+            if(!int_argument(argc, argv, &i, &opts->tile_size) || opts->tile_size == 0){
+                return false;
+            }
+            if(opts->tile_size > MAX_TILE){
+                fprintf(stderr, "%s: tiles are at most %d pixels a side\n", argv[0],
+                        MAX_TILE);
+                return false;
+            }
+        } else if(strcmp(argv[i], "--kernel") == 0){
+            if(++i >= argc){
+                fprintf(stderr, "%s: missing kernel name after %s\n", argv[0], argv[i-1]);
+                return false;
+            }
+            opts->kernel = argv[i];
+        } else if(strcmp(argv[i], "--packet") == 0){
+            if(!int_argument(argc, argv, &i, &opts->packet_size)){
+                return false;
+            }
+            /*the edge first, its square overflows for large ones*/
+            if(opts->packet_size > 8 || opts->packet_size * opts->packet_size > MAX_PACKET){
+                fprintf(stderr, "%s: packets are at most 8x8 rays\n", argv[0]);
+                return false;
+            }
+        } else if(strcmp(argv[i], "--engine") == 0){
+            if(++i >= argc || (strcmp(argv[i], "recursive") != 0
+                        && strcmp(argv[i], "wavefront") != 0)){
+                fprintf(stderr, "%s: --engine takes recursive or wavefront\n", argv[0]);
+                return false;
+            }
+            opts->wavefront = strcmp(argv[i], "wavefront") == 0;
+        } else if(strcmp(argv[i], "--depth") == 0){
+            if(!int_argument(argc, argv, &i, &opts->max_depth)){
+                return false;
+            }
+            if(opts->max_depth > MAX_DEPTH){
+                fprintf(stderr, "%s: --depth is at most %d\n", argv[0], MAX_DEPTH);
+                return false;
+            }
+        } else if(strcmp(argv[i], "--min-weight") == 0){
+            if(!double_argument(argc, argv, &i, &opts->min_weight)){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--aa") == 0){
+            int n;
+            if(!int_argument(argc, argv, &i, &opts->aa)){
+                return false;
+            }
+            /*each level of subdivision takes four samples*/
+            n = opts->aa;
+            while(n > 1 && n % 4 == 0){
+                n /= 4;
+            }
+            if(n != 1 || opts->aa > MAX_AA){
+                fprintf(stderr, "%s: --aa takes 1, 4, 16 or 64 samples\n", argv[0]);
+                return false;
+            }
+        } else if(strcmp(argv[i], "--roulette") == 0){
+            opts->roulette = true;
+        } else if(strcmp(argv[i], "--stats") == 0){
+            opts->stats = true;
+        } else if(strcmp(argv[i], "--stats-json") == 0){
+            opts->stats = opts->stats_json = true;
+        } else if(strcmp(argv[i], "--spline-grid") == 0){
+            double u = 0, v = 0;
+            if(!size_argument(argc, argv, &i, &u, &v)){
+                return false;
+            }
+            /*bounded first, as for --size*/
+            if(u > MAX_SPLINE_GRID || v > MAX_SPLINE_GRID || u != (int)u || v != (int)v){
+                fprintf(stderr, "%s: --spline-grid takes whole quads, at most %d a side\n",
+                        argv[0], MAX_SPLINE_GRID);
+                return false;
+            }
+            opts->spline_u = (int)u;
+            opts->spline_v = (int)v;
+        } else if(strcmp(argv[i], "--no-hit-cache") == 0){
+            opts->hit_cache = false;
+        } else if(strcmp(argv[i], "--no-bvh") == 0){
+            opts->use_bvh = false;
+        } else if(strcmp(argv[i], "--no-shadows") == 0){
+            opts->shadows = false;
+        } else if(strcmp(argv[i], "--no-occluder-cache") == 0){
+            opts->occluder_cache = false;
+        } else if(strcmp(argv[i], "--no-light-grid") == 0){
+            opts->use_light_grid = false;
+        } else if(strcmp(argv[i], "--serve") == 0 || strcmp(argv[i], "--farm") == 0
+                || strcmp(argv[i], "--worker") == 0){
+            if(++i >= argc){
+                fprintf(stderr, "%s: missing address after %s\n", argv[0], argv[i-1]);
+                return false;
+            }
+            if(strcmp(argv[i-1], "--serve") == 0){
+                opts->serve = argv[i];
+            } else if(strcmp(argv[i-1], "--farm") == 0){
+                opts->farm = argv[i];
+            } else {
+                opts->worker = argv[i];
+            }
+        } else if(strcmp(argv[i], "--farm-timeout") == 0){
+            if(!double_argument(argc, argv, &i, &opts->farm_timeout)
+                    || opts->farm_timeout == 0){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--drop-after") == 0){
+            if(!int_argument(argc, argv, &i, &opts->drop_after)){
+                return false;
+            }
+        } else if(strcmp(argv[i], "--stall-after") == 0){
+            if(!int_argument(argc, argv, &i, &opts->stall_after)){
+                return false;
+            }
+        } else if(!allow_unknown){
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+void print_usage(const char * program){
+    fprintf(stderr,
+        "usage: %s [--headless] [-o file] [--stream] [--scene file]\n"
+        "       [--size WxH] [--extent WxH] [-t threads] [--tile size]\n"
+        "       [--no-bvh] [--no-shadows] [--no-occluder-cache] [--no-light-grid]\n"
+        "       [--kernel scalar|sse2|avx2] [--packet size]\n"
+        "       [--engine recursive|wavefront] [--depth n] [--min-weight w]\n"
+        "       [--roulette] [--aa samples] [--no-hit-cache] [--spline-grid UxV]\n"
+        "       [--stats]\n"
+        "       [--stats-json] [--serve address] [--farm address] [--worker address]\n"
+        "       [--farm-timeout seconds] [--drop-after n] [--stall-after n]\n"
+        "  --headless       render without opening a window\n"
+        "  -o, --output     image to write in headless mode (.ppm or .png)\n"
+        "  --stream         in headless mode write the image a band of tiles at a\n"
+        "                   time as it is traced, without holding all of it\n"
+        "  --scene          scene file to render, text or binary (default: the\n"
+        "                   built in scene)\n"
+        "  --size           image size in pixels (default: 300x300)\n"
+        "  --extent         size of the scene's rectangle the image shows\n"
+        "                   (default: the scene's camera, fitted to the\n"
+        "                   image's shape)\n"
+        "  -t, --threads    render threads (default: one per cpu)\n"
+        "  --tile           tile edge in pixels, up to 16384 (default: 16)\n"
+        "  --no-bvh         test every sphere instead of using the hierarchy\n"
+        "  --no-shadows     light every hit as if nothing blocked the light\n"
+        "  --no-occluder-cache\n"
+        "                   do not try the sphere that blocked the last shadow\n"
+        "                   ray first\n"
+        "  --no-light-grid  try every point light at every hit instead of the\n"
+        "                   ones whose grid cells reach it\n"
+        "  --kernel         ray/sphere kernel (default: widest the cpu supports)\n"
+        "  --packet         trace primary rays in size x size packets, 1 for\n"
+        "                   single rays (default: 4)\n"
+        "  --engine         follow reflections depth first (recursive, the\n"
+        "                   default) or a tile at a time bounce by bounce\n"
+        "  --depth          most bounces of a ray, up to 64 (default: 5)\n"
+        "  --min-weight     drop reflections that scale into the pixel by\n"
+        "                   less than w (default: half an 8 bit step)\n"
+        "  --roulette       keep light reflections at random instead, with\n"
+        "                   unbiased reweighting\n"
+        "  --aa             anti-alias edges with up to 4, 16 or 64 samples a\n"
+        "                   pixel, only where neighbours differ (default: 1, off;\n"
+        "                   not with --stream)\n"
+        "  --no-hit-cache   trace the whole scene again when the viewer's light\n"
+        "                   moves instead of re-shading the cached hits\n"
+        "  --spline-grid    quads across and up each patch of the viewer's side\n"
+        "                   panels, tessellated once at start (default: 20x10)\n"
+        "  --stats          print ray counts and time per phase at exit (and\n"
+        "                   on S in the viewer)\n"
+        "  --stats-json     the same as JSON\n"
+        "  --serve          in headless mode keep running and render the\n"
+        "                   requests sent to unix:PATH, keeping the scenes\n"
+        "                   loaded (see the README)\n"
+        "  --farm           in headless mode hand the frame's tiles out to\n"
+        "                   workers connecting to unix:PATH or [HOST]:PORT\n"
+        "                   instead of tracing them (not with --aa, --stream\n"
+        "                   or keyframes)\n"
+        "  --worker         trace tiles for the farm at unix:PATH or HOST:PORT,\n"
+        "                   which sends the scene and settings, until it is done\n"
+        "  --farm-timeout   seconds a farm waits on a worker's job before\n"
+        "                   handing it to another (default: 30)\n"
+        "  --drop-after     a worker goes away when handed its n-th job, to\n"
+        "                   try a farm's recovery\n"
+        "  --stall-after    a worker stops answering at its n-th job\n",
+        program);
+}
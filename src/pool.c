@@ -0,0 +1,215 @@
+/*********************
+ * Work-stealing tile scheduler.
+ *
+ * Each worker owns a run of tile numbers [begin, end) packed into one
+ * 64 bit atomic. The owner takes tiles from the front, thieves take the
+ * back half, both with a compare and swap, so no locks are held while
+ * tiles are being handed out. The calling thread acts as worker 0, the
+ * others sleep on a condition variable between jobs.
+ */
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64
+
+/*the tiles a worker still owns, one per cache line*/
+typedef struct tile_range_struct {
+    _Alignas(CACHE_LINE) _Atomic uint64_t range;
+} tile_range;
+
+struct render_pool_struct {
+    int threads;
+    pthread_t * workers;
+    tile_range * queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned long generation;
+    int busy;
+    bool quit;
+
+    tile_job job;
+    void * arg;
+};
+
+/*a helper thread and the worker number it runs as*/
+typedef struct worker_arg_struct {
+    render_pool * pool;
+    int worker;
+} worker_arg;
+
+static uint64_t pack_range(uint32_t begin, uint32_t end){
+    return ((uint64_t)end << 32) | begin;
+}
+
+/*takes the next tile of the worker's own run, returns -1 if it is empty*/
+static int take_tile(tile_range * q){
+    uint64_t r = atomic_load(&q->range);
+    uint32_t begin, end;
+    do {
+        begin = (uint32_t)r;
+        end = (uint32_t)(r >> 32);
+        if(begin >= end){
+            return -1;
+        }
+    } while(!atomic_compare_exchange_weak(&q->range, &r, pack_range(begin + 1, end)));
+    return begin;
+}
+
+/*moves the back half of some other worker's run into our own (empty) run*/
+static bool steal_tiles(render_pool * pool, int worker){
+    int i, victim;
+    uint64_t r;
+    uint32_t begin, end, n;
+
+    for(i = 1; i < pool->threads; ++i){
+        tile_range * q;
+        victim = (worker + i) % pool->threads;
+        q = &pool->queues[victim];
+        r = atomic_load(&q->range);
+        do {
+            begin = (uint32_t)r;
+            end = (uint32_t)(r >> 32);
+            n = end > begin ? (end - begin + 1) / 2 : 0;
+        } while(n > 0
+                && !atomic_compare_exchange_weak(&q->range, &r, pack_range(begin, end - n)));
+        if(n > 0){
+            atomic_store(&pool->queues[worker].range, pack_range(end - n, end));
+            return true;
+        }
+    }
+    return false;
+}
+
+/*runs tiles until there are none left anywhere*/
+static void work(render_pool * pool, int worker){
+    int tile;
+    do {
+        while((tile = take_tile(&pool->queues[worker])) >= 0){
+            pool->job(pool->arg, tile, worker);
+        }
+    } while(steal_tiles(pool, worker));
+}
+
+static void * worker_main(void * p){
+    worker_arg * wa = p;
+    render_pool * pool = wa->pool;
+    int worker = wa->worker;
+    unsigned long seen = 0;
+
+    free(wa);
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        while(pool->generation == seen && !pool->quit){
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if(pool->quit){
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->busy == 0){
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int online_cpus(){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/*creates a pool of threads workers (including the caller), 0 means one
+ * per online cpu*/
+render_pool * create_pool(int threads){
+    int i;
+    render_pool * pool = calloc(1, sizeof(render_pool));
+
+    if(threads <= 0){
+        threads = online_cpus();
+    }
+    pool->threads = threads;
+    pool->queues = aligned_alloc(CACHE_LINE, sizeof(tile_range) * threads);
+    pool->workers = calloc(threads, sizeof(pthread_t));
+    for(i = 0; i < threads; ++i){
+        atomic_init(&pool->queues[i].range, 0);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for(i = 1; i < threads; ++i){
+        worker_arg * wa = malloc(sizeof(worker_arg));
+        wa->pool = pool;
+        wa->worker = i;
+        pthread_create(&pool->workers[i], NULL, worker_main, wa);
+    }
+    return pool;
+}
+
+void destroy_pool(render_pool * pool){
+    int i;
+    if(pool == NULL){
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for(i = 1; i < pool->threads; ++i){
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool->queues);
+    free(pool);
+}
+
+int pool_threads(const render_pool * pool){
+    return pool->threads;
+}
+
+/*calls job for every tile in [0, tiles) and returns once all are done*/
+void pool_run(render_pool * pool, int tiles, tile_job job, void * arg){
+    int i;
+
+    for(i = 0; i < pool->threads; ++i){
+        atomic_store(&pool->queues[i].range,
+                pack_range((uint64_t)tiles * i / pool->threads,
+                           (uint64_t)tiles * (i + 1) / pool->threads));
+    }
+    pool->job = job;
+    pool->arg = arg;
+
+    if(pool->threads > 1){
+        pthread_mutex_lock(&pool->lock);
+        pool->busy = pool->threads - 1;
+        ++pool->generation;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    work(pool, 0);
+
+    if(pool->threads > 1){
+        pthread_mutex_lock(&pool->lock);
+        while(pool->busy > 0){
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
@@ -18,226 +18,226 @@
  * Key commands:
  *      'G' - render the scene
  *      'L' - toggle the light '20' units to the right
+ *      'S' - print ray counts and time per phase (as JSON with --stats-json)
  *      'X' - exit the program
  * 
+ * Rendering happens on a background thread, coarse blocks first, while
+ * a timer redraws the partial image with a progress bar under it. A new
+ * request cancels the render in flight. Once a render has finished, 'L'
+ * re-shades its cached hits instead of tracing the scene again.
+ * 
  * Notable functions and structures:
  * 
  * keyboard_input - the keyboard callback hander to accept user input
  * display_func - display callback function
+ * start_render - (re)starts the background render of the scene
+ * stop_render - cancels the background render and waits for it
+ * 
+ * The ray tracing itself (phong_sphere, cast_ray, add_sphere) lives in
+ * scene.c and the multi-threaded compute_scene in render.c so it can also
+ * be run without a window, see
+ * 'rayfoo --headless -o out.ppm' or the GL-free rayfoo-headless.
  * 
- * phong_sphere - used to apply Phong Illumination to a sphere
- * cast_ray - apply the raycasting algorithm
- * compute_scene - computes the scene and stores in an intermediate buffer
- *                      scene
- * find_intersection - finds the intersection of a sphere and a ray
+ * init_canvas_texture - creates the texture the ray traced image is shown in
+ * pack_rows - converts rows of canvas to RGBA bytes
+ * upload_rows - copies rows of canvas into that texture
+ * draw_canvas - draws the texture as a single quad
  * 
- * add_sphere - used to add a sphere to the linked list
  * init_light - initializes a light in openGL
- * draw_spline_surface - uses openGL commands to draw a spline patch
- * draw_splines - draws a sin approximation spline patch at the given
- *                  offset, enables Phong lighting
+ * eval_spline - a point of a bicubic patch and its normal
+ * build_spline_panel - tessellates a side panel's sin approximation
+ *                  patches once, into buffer objects
+ * init_spline_panels - builds both panels and sets their material
+ * draw_splines - draws a tessellated panel with one call, enables Phong
+ *                  lighting
  * 
  * 
  * 
- * scene - an array that holds the computed color values for the scene from
- *              the ray tracing algorithm
- * sphere - structure to represent a sphere
- * sphere_list - structure to represent a list of spheres and their
- *                  material properties (linked list)
- * light - holds information about a light
  * spline_material_* - material components for splines
  * 
  */
 #include "colors.h"
 #include "geometry.h"
+#include "headless.h"
+#include "image.h"
+#include "options.h"
+#include "render.h"
+#include "scene.h"
+#include "scenefile.h"
 
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+/*for the buffer object entry points, which GL 1.x headers only declare
+ * as extensions*/
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
 
 #include "my_setup.h"
 
-#define CANVAS_WIDTH 300
-#define CANVAS_HEIGHT 300
-
-#define SCENE_WIDTH 200
-#define SCENE_HEIGHT 200
-
 #define SPLINE_WIDTH 250
+/*milliseconds between redraws while a render is in flight*/
+#define REDRAW_INTERVAL 33
+/*how far along x the 'L' key moves the light*/
+#define LIGHT_SHIFT 20
 
 bool show_message = true;
-unsigned int max_ray_depth = 5;
 
-double scene_floor = -SCENE_HEIGHT/2;
-
-color canvas[CANVAS_WIDTH*CANVAS_HEIGHT];
+/*the ray traced scene and the threads that render it*/
+scene the_scene;
+renderer the_renderer;
+/*x of the scene's light as loaded, which the 'L' key moves it from*/
+real light_home_x;
+/*size of the ray traced image, from --size*/
+int canvas_width, canvas_height;
+
+/*the background render, render_started until it is joined*/
+pthread_t render_thread;
+bool render_started = false;
+atomic_bool render_running;
+bool redraw_armed = false;
+
+/*--stats and --stats-json*/
+bool stats_at_exit = false;
+bool stats_json = false;
+
+/*the ray traced image as an RGBA texture, streamed through a pixel
+ * buffer object when the GL has them and from canvas_rgba otherwise*/
+GLuint canvas_texture;
+GLuint canvas_pbo;
+bool use_pbo = false;
+unsigned char * canvas_rgba;
 
 /*spline material components*/
 float spline_material_a[4] = {0.1,0.6,0.1, 1.0};
 float spline_material_d[4] = {0.4,0.8,0.4, 1.0};
 float spline_material_s[4] = {0.3,0.75,0.3, 1.0};
 
-
-/*a structure to represent a list of spheres and their properties*/
-typedef struct sphere_list_struct {
-    sphere s;
-    color ambient, diffuse, specular;
-    double s_exp, reflectivity;
-    struct sphere_list_struct * next;
-} sphere_list;
-
-
-/*represents a light by location and coloration*/
-typedef struct light_struct {
-    point location;
-    color ambient, diffuse, specular;
-} light;
+/*a side panel's three patches, tessellated once: x y z and the normal
+ * of each vertex, and the triangles over them. In buffer objects when
+ * the GL has them (the arrays are then freed), drawn from the arrays
+ * otherwise*/
+typedef struct spline_panel_struct {
+    float left;             /*x offset of the panel*/
+    float * vertices;
+    GLuint * indices;
+    int index_count;
+    GLuint buffers[2];      /*vertices and indices*/
+} spline_panel;
+
+/*the left and right panels, and the quads across and up each patch is
+ * split in, from --spline-grid*/
+spline_panel spline_panels[2];
+int spline_u, spline_v;
+bool use_vbo = false;
 
 
-/*the single light for the scene*/
-light light0;
-/*list of spheres in the scene*/
-sphere_list * list;
-
-
-/*finds the Phong Illumination at the given point on the sphere at center sphere_center
- * with the given material properties*/
-color phong_sphere(point sphere_center, point p, point viewer, color ambient, color diffuse, 
-                    color specular, double specular_exp, light lght){
-    vector l = normalize_vector(points_to_vector(p,lght.location));
-    vector v = normalize_vector(points_to_vector(p, viewer));
-    vector n = normalize_vector(points_to_vector( sphere_center, p));
-    vector h = scale_vector(0.5, add_vectors(l, v));
-    
-    color ambient_r = multiply_colors(ambient, lght.ambient);
-    
-    color diffuse_r = scale_color(dot_vector(l, n), 
-                        multiply_colors(diffuse, lght.diffuse));
-    double spec_scale1 = fabs(dot_vector(h,n));
-    double spec_scale2 = specular_exp;
-    color specular_r = scale_color(pow(fabs(dot_vector(h,n)), specular_exp), 
-                          multiply_colors(specular, lght.specular));
-                          
-    return add_colors3(ambient_r, diffuse_r, specular_r); 
+/* draws the given null terminated string str to the string 
+ * at position (x, y) */
+void drawString(int x, int y, char str[]) {
     
+    int i;
+    glRasterPos2i(x,y);
+    for(i = 0; str[i] != '\0'; ++i) {
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_10, str[i]);
+    }
 }
 
-/*cast a ray into the scene, depth is used to stop the recursion*/
-color cast_ray(ray r, int depth){
-    color tmp1, tmp2, tmp3, tmp4;
-    
-    vector normal, incident, reflect;
-    double cosi;
-    color result = {BLACK}, reflect_color;
-    point p, p_saved;
-    bool found = false, any_found = false;
-    sphere_list * sl = list, sl_closest;
-    
-    if(depth++ >= max_ray_depth){
-        return result;
-    }
-    //find intersection
-    while(sl != NULL){
-        p = find_intersection(sl->s, r, &found);
-        /*only update if intersection was found*/
-        if(found){
-            /*use if closer*/
-            if(!any_found 
-               || (distance_sq(r.orgin, p) < distance_sq(p_saved, r.orgin))){ 
-                sl_closest = (*sl);
-                p_saved = p;
-                any_found = true;
-            }
-            found = false;
-        }
-        sl = (sl->next);
-    }
-    
-    if(!any_found){
-        //test for intersection with bottom
-        if(r.at.y - r.orgin.y < 0){
-            p_saved = find_y_plane_intersection(r, scene_floor);
-            incident =  normalize_vector(ray_to_vector(r));
-            normal.x = 0;
-            normal.y = 1;
-            normal.z = 0;
-            // use bottom as mirror
-            cosi = dot_vector(scale_vector(-1, incident), normal);
-            reflect = normalize_vector(add_vectors(incident,scale_vector(2*cosi, normal)));
-            reflect_color = cast_ray(point_vector_to_ray(p_saved, reflect), depth);
-            result = add_colors(result, reflect_color);
-        }
-        /*no intersections means the light has left the scene*/
-        return result;
-    }
-    
-    //do Phong
-    result = phong_sphere(sl_closest.s.center, p_saved, r.orgin, 
-        sl_closest.ambient, sl_closest.diffuse, sl_closest.specular, sl_closest.s_exp,
-        light0);
-    
-    //cast reflection
-    incident =  normalize_vector(ray_to_vector(r));
-    normal = normalize_vector(points_to_vector(sl_closest.s.center, p_saved));
-    cosi = dot_vector(scale_vector(-1, incident), normal);
-    reflect = normalize_vector(add_vectors(incident,scale_vector(2*cosi, normal)));
-    
-    
-    reflect_color = cast_ray(point_vector_to_ray(p_saved, reflect), depth);
-    result.r += sl_closest.reflectivity * reflect_color.r;
-    result.g += sl_closest.reflectivity * reflect_color.g;
-    result.b += sl_closest.reflectivity * reflect_color.b;
-    
+/*draws a bar along the bottom of the ray traced image filled to the
+ * given share, with the percentage above it*/
+void draw_progress(double done){
+    char text[32];
+    double left = -my_width/2, bottom = -my_height/2;
+
+    glColor4f(GREEN);
+    glBegin(GL_QUADS);
+    glVertex2d(left, bottom);
+    glVertex2d(left + done*canvas_width, bottom);
+    glVertex2d(left + done*canvas_width, bottom + 3);
+    glVertex2d(left, bottom + 3);
+    glEnd();
 
-    //cast refraction here if desired
-    
-    
-    return result;
+    snprintf(text, sizeof(text), "Rendering %d%%", (int)(done*100));
+    drawString(left + 2, bottom + 6, text);
 }
 
-/*colors the given pixel with the given color*/
-void color_pixel(double x, double y, color c){
-    
-    glColor3f(c.r, c.g, c.b);
-    glVertex2d(x, y);
-    
-    
+/*packs the rows [first, last) of the renderer's canvas into out*/
+void pack_rows(unsigned char * out, int first, int last){
+    const framebuffer * fb = &the_renderer.canvas;
+    int row;
+    for(row = first; row < last; ++row){
+        pack_rgba(out + (size_t)(row - first) * fb->width * 4,
+                &fb->pixels[(size_t)row * fb->stride], fb->width);
+    }
 }
 
-/*cast rays out of every pixel in the given square*/
-void compute_scene(int x1, int y1, int x2, int y2){
-    int x, y;
-    double height_ratio = (SCENE_HEIGHT/(double)CANVAS_HEIGHT),
-            width_ratio = (SCENE_WIDTH/(double)CANVAS_WIDTH);
-    int count = 0;
-    ray r;
-    
-    r.orgin.z = 0.0;
-    r.at.z = -1.0;
-    
-    for(y = 0; y < CANVAS_HEIGHT; ++y){
-        for(x = 0; x < CANVAS_WIDTH; ++x){
-            
-            r.orgin.x = r.at.x = ((double)x)*width_ratio + x1; 
-            r.orgin.y = r.at.y = ((double)y)*height_ratio + y1;
-            
-            canvas[y*CANVAS_WIDTH + x] = cast_ray(r, 0);
+/*copies the rows [first, last) of canvas into the texture*/
+void upload_rows(int first, int last){
+    size_t size = (size_t)(last - first) * canvas_width * 4;
+    unsigned char * out;
+
+    glBindTexture(GL_TEXTURE_2D, canvas_texture);
+    if(use_pbo){
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, canvas_pbo);
+        /*a fresh store each time so the GL need not wait for the last
+         * upload to finish reading the old one*/
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        out = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if(out != NULL){
+            pack_rows(out, first, last);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, canvas_width, last - first,
+                    GL_RGBA, GL_UNSIGNED_BYTE, NULL);
         }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        pack_rows(canvas_rgba, first, last);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, canvas_width, last - first,
+                GL_RGBA, GL_UNSIGNED_BYTE, canvas_rgba);
     }
-    
 }
 
-/* draws the given null terminated string str to the string 
- * at position (x, y) */
-void drawString(int x, int y, char str[]) {
-    
-    int i;
-    glRasterPos2i(x,y);
-    for(i = 0; str[i] != '\0'; ++i) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_10, str[i]);
+/*creates the texture canvas is shown in, needs a current GL context*/
+void init_canvas_texture(){
+    glGenTextures(1, &canvas_texture);
+    glBindTexture(GL_TEXTURE_2D, canvas_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, canvas_width, canvas_height, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    use_pbo = glutExtensionSupported("GL_ARB_pixel_buffer_object");
+    if(use_pbo){
+        glGenBuffers(1, &canvas_pbo);
+    } else {
+        canvas_rgba = malloc((size_t)canvas_width * canvas_height * 4);
     }
+    upload_rows(0, canvas_height);
+}
+
+/*draws the texture over the ray traced part of the window*/
+void draw_canvas(){
+    double left = -my_width/2, bottom = -my_height/2;
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, canvas_texture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0);
+    glVertex2d(left, bottom);
+    glTexCoord2f(1, 0);
+    glVertex2d(left + canvas_width, bottom);
+    glTexCoord2f(1, 1);
+    glVertex2d(left + canvas_width, bottom + canvas_height);
+    glTexCoord2f(0, 1);
+    glVertex2d(left, bottom + canvas_height);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
 }
 
 /*initializes a light in openGL*/
@@ -253,48 +253,149 @@ void init_light(GLenum l_enum, light l){
     glLightfv(l_enum, GL_SPECULAR, spe);
 }
 
-/*turns the given control points into a visible spline pathch*/
-void draw_spline_surface(float * ctrl_points){
-    glMap2f(GL_MAP2_VERTEX_3, 0, 1, 3, 4,
-           0, 1, 12, 4, ctrl_points);
-    
-    glEnable(GL_MAP2_VERTEX_3);
-    
-           
-    glMapGrid2f(20, 0, 1, 10, 0, 1);
-    glEvalMesh2(GL_FILL, 0, 20, 0, 10);
-    
-    glMapGrid2f(20, 0.0, 1.0, 10, 0.0, 1.0);
+/*the value and the derivative at t of the four cubic Bernstein
+ * polynomials*/
+void bernstein(float t, float b[4], float db[4]){
+    float s = 1 - t;
+    b[0] = s*s*s;
+    b[1] = 3*t*s*s;
+    b[2] = 3*t*t*s;
+    b[3] = t*t*t;
+    db[0] = -3*s*s;
+    db[1] = 3*s*s - 6*t*s;
+    db[2] = 6*t*s - 3*t*t;
+    db[3] = 3*t*t;
+}
+
+/*evaluates the bicubic patch of ctrl_points, laid out as glMap2f takes
+ * them with u along a row and v across the rows, at (u, v): the point
+ * into out[0..2] and the unit normal dP/du x dP/dv, as GL_AUTO_NORMAL
+ * makes it, into out[3..5]*/
+void eval_spline(const float ctrl_points[4][4][3], float u, float v, float * out){
+    float bu[4], dbu[4], bv[4], dbv[4], du[3] = {0}, dv[3] = {0}, length;
+    int i, j, k;
+
+    bernstein(u, bu, dbu);
+    bernstein(v, bv, dbv);
+    out[0] = out[1] = out[2] = 0;
+    for(j = 0; j < 4; ++j){
+        for(i = 0; i < 4; ++i){
+            for(k = 0; k < 3; ++k){
+                out[k] += bu[i]*bv[j]*ctrl_points[j][i][k];
+                du[k] += dbu[i]*bv[j]*ctrl_points[j][i][k];
+                dv[k] += bu[i]*dbv[j]*ctrl_points[j][i][k];
+            }
+        }
+    }
+    out[3] = du[1]*dv[2] - du[2]*dv[1];
+    out[4] = du[2]*dv[0] - du[0]*dv[2];
+    out[5] = du[0]*dv[1] - du[1]*dv[0];
+    length = sqrtf(out[3]*out[3] + out[4]*out[4] + out[5]*out[5]);
+    if(length > 0){
+        out[3] /= length;
+        out[4] /= length;
+        out[5] /= length;
+    }
 }
 
-/*draws a spline patch at the given x offset*/
-void draw_splines(double left){
+/*the control points of the three patches of the side panel at the given
+ * x offset, sine approximations side by side*/
+void spline_control_points(float ctrl_points[3][4][4][3], float left){
     float div = SPLINE_WIDTH/12;
-    float low_z = -60, mid_z = -30, high_z = 0.0;
-    float y1 = 0, y2 = CANVAS_HEIGHT/3, y3 = CANVAS_HEIGHT*2/3, y4 = CANVAS_HEIGHT;
-    float ctrl_points1[4][4][3] = {
-   { {left, y1,   mid_z},    {div+left, y1, high_z},    {div*2+left, y1, low_z},   {div*3+left, y1, mid_z}}, 
-   { {left, y2, mid_z},  {div+left, y2, high_z},  {div*2+left, y2, low_z},  {div*3+left, y2, mid_z}}, 
-   { {left, y3, mid_z},  {div+left, y3, high_z},  {div*2+left, y3, low_z},  {div*3+left, y3, mid_z}}, 
-   { {left, y4, mid_z}, {div+left, y4, high_z}, {div*2+left, y4, low_z},  {div*3+left, y4, mid_z}}
-   };/**/
-   float ctrl_points2[4][4][3] = {
-   { {left+div*3, y1, mid_z},    {div*4+left, y1, high_z},    {div*5+left, y1, low_z},   {div*6+left, y1, mid_z}}, 
-   { {left+div*3, y2, mid_z},  {div*4+left, y2, high_z},  {div*5+left, y2, low_z},  {div*6+left, y2, mid_z}}, 
-   { {left+div*3, y3, mid_z},  {div*4+left, y3, high_z},  {div*5+left, y3, low_z},  {div*6+left, y3, mid_z}}, 
-   { {left+div*3, y4, mid_z}, {div*4+left, y4, high_z}, {div*5+left, y4, low_z},  {div*6+left, y4, mid_z}}
-   };/**/
-   float ctrl_points3[4][4][3] = {
-   { {left+div*6, y1, mid_z},    {div*7+left, y1, high_z},    {div*8+left, y1, low_z},   {div*9+left, y1, mid_z}}, 
-   { {left+div*6, y2, mid_z},  {div*7+left, y2, high_z},  {div*8+left, y2, low_z},  {div*9+left, y2, mid_z}}, 
-   { {left+div*6, y3, mid_z},  {div*7+left, y3, high_z},  {div*8+left, y3, low_z},  {div*9+left, y3, mid_z}}, 
-   { {left+div*6, y4, mid_z}, {div*7+left, y4, high_z}, {div*8+left, y4, low_z},  {div*9+left, y4, mid_z}}
-   };/**/
-    
+    float z[4] = {-30, 0.0, -60, -30};      /*mid, high, low, mid*/
+    float y[4] = {0, canvas_height/3, canvas_height*2/3, canvas_height};
+    int p, i, j;
+
+    for(p = 0; p < 3; ++p){
+        for(j = 0; j < 4; ++j){
+            for(i = 0; i < 4; ++i){
+                ctrl_points[p][j][i][0] = div*(3*p + i) + left;
+                ctrl_points[p][j][i][1] = y[j];
+                ctrl_points[p][j][i][2] = z[i];
+            }
+        }
+    }
+}
+
+/*evaluates the patches of the side panel at left once, each on a grid
+ * of spline_u x spline_v quads split in two triangles facing the way
+ * glEvalMesh2's quad strips did, and stores them in buffer objects when
+ * the GL has them*/
+void build_spline_panel(spline_panel * panel, float left){
+    float ctrl_points[3][4][4][3], * v;
+    GLuint * index, first;
+    int p, i, j, columns = spline_u + 1, vertex_count;
+
+    panel->left = left;
+    spline_control_points(ctrl_points, left);
+    vertex_count = 3 * columns * (spline_v + 1);
+    panel->index_count = 3 * spline_u * spline_v * 6;
+    panel->vertices = v = malloc(sizeof(float) * 6 * vertex_count);
+    panel->indices = index = malloc(sizeof(GLuint) * panel->index_count);
+
+    for(p = 0; p < 3; ++p){
+        first = p * columns * (spline_v + 1);
+        for(j = 0; j <= spline_v; ++j){
+            for(i = 0; i <= spline_u; ++i){
+                eval_spline(ctrl_points[p], (float)i / spline_u, (float)j / spline_v, v);
+                v += 6;
+            }
+        }
+        /*the quad strip v0 (i, j), v1 (i, j+1), v2 (i+1, j), v3 (i+1, j+1)
+         * as the triangles v0 v1 v2 and v2 v1 v3*/
+        for(j = 0; j < spline_v; ++j){
+            for(i = 0; i < spline_u; ++i){
+                GLuint v0 = first + j*columns + i, v1 = v0 + columns;
+                *index++ = v0;
+                *index++ = v1;
+                *index++ = v0 + 1;
+                *index++ = v0 + 1;
+                *index++ = v1;
+                *index++ = v1 + 1;
+            }
+        }
+    }
+
+    if(use_vbo){
+        glGenBuffers(2, panel->buffers);
+        glBindBuffer(GL_ARRAY_BUFFER, panel->buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * vertex_count, panel->vertices,
+                GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, panel->buffers[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * panel->index_count,
+                panel->indices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        free(panel->vertices);
+        free(panel->indices);
+        panel->vertices = NULL;
+        panel->indices = NULL;
+    }
+}
+
+/*tessellates both side panels and sets their material, which nothing
+ * else changes; needs a current GL context and canvas_height*/
+void init_spline_panels(){
+    use_vbo = glutExtensionSupported("GL_ARB_vertex_buffer_object");
+    build_spline_panel(&spline_panels[0], 0);
+    build_spline_panel(&spline_panels[1], SPLINE_WIDTH/2 + canvas_width);
+
+    glMaterialf(GL_FRONT, GL_SHININESS, 5.0);
+    glMaterialfv(GL_FRONT, GL_AMBIENT, spline_material_a);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, spline_material_a);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, spline_material_s);
+}
+
+/*draws a tessellated side panel in its own projection, Phong lit*/
+void draw_splines(const spline_panel * panel){
+    /*offsets into the buffer objects, or addresses of the arrays*/
+    const char * vertices = use_vbo ? NULL : (const char *)panel->vertices;
+    const GLuint * indices = use_vbo ? NULL : panel->indices;
+
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
     glLoadIdentity();
-    glOrtho((GLdouble) left, (GLdouble) SPLINE_WIDTH/2 + left, 
+    glOrtho((GLdouble) panel->left, (GLdouble) SPLINE_WIDTH/2 + panel->left,
             (GLdouble) 0, (GLdouble) SCENE_HEIGHT, -100, 100);
     
     glMatrixMode(GL_MODELVIEW);
@@ -304,13 +405,21 @@ void draw_splines(double left){
     /*Turn on phong*/
     glEnable(GL_LIGHTING);
     
-    glMaterialf(GL_FRONT, GL_SHININESS, 5.0);
-    glMaterialfv(GL_FRONT, GL_AMBIENT, spline_material_a);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, spline_material_a);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, spline_material_s);
-    draw_spline_surface(&ctrl_points1[0][0][0]);
-    draw_spline_surface(&ctrl_points2[0][0][0]);
-    draw_spline_surface(&ctrl_points3[0][0][0]);
+    if(use_vbo){
+        glBindBuffer(GL_ARRAY_BUFFER, panel->buffers[0]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, panel->buffers[1]);
+    }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), vertices);
+    glNormalPointer(GL_FLOAT, 6 * sizeof(float), vertices + 3 * sizeof(float));
+    glDrawElements(GL_TRIANGLES, panel->index_count, GL_UNSIGNED_INT, indices);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    if(use_vbo){
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
     
     /*set everything back to normal*/
     glDisable(GL_LIGHTING);
@@ -323,50 +432,48 @@ void draw_splines(double left){
 
 void setup_raytrace_camera(){
     double view_port_start = SPLINE_WIDTH/2;
-    glViewport(view_port_start, 0, CANVAS_WIDTH, CANVAS_HEIGHT);
+    glViewport(view_port_start, 0, canvas_width, canvas_height);
     glMatrixMode(GL_PROJECTION);
 
     //setting viewing parameters to simple 2D viewing
     glLoadIdentity();
-    gluOrtho2D((GLdouble) -CANVAS_WIDTH/2 - view_port_start, 
-                (GLdouble) CANVAS_WIDTH/2 - view_port_start, 
-                (GLdouble) -CANVAS_HEIGHT/2, (GLdouble) CANVAS_HEIGHT/2);
+    gluOrtho2D((GLdouble) -canvas_width/2 - view_port_start, 
+                (GLdouble) canvas_width/2 - view_port_start, 
+                (GLdouble) -canvas_height/2, (GLdouble) canvas_height/2);
     
     glMatrixMode(GL_MODELVIEW);
 }
 
 /*display callback handler*/
 void display_func(){
-    int x, y;
+    struct timespec start = phase_start();
+    int first, last;
     double view_port_start = SPLINE_WIDTH/2;
     
     
-    glViewport(0, 0, view_port_start, CANVAS_HEIGHT);
-    draw_splines(0);
+    glViewport(0, 0, view_port_start, canvas_height);
+    draw_splines(&spline_panels[0]);
     
-    glViewport(CANVAS_WIDTH + view_port_start, 0, 
-                view_port_start, CANVAS_HEIGHT);
-    draw_splines(SPLINE_WIDTH/2 + CANVAS_WIDTH);
+    glViewport(canvas_width + view_port_start, 0, 
+                view_port_start, canvas_height);
+    draw_splines(&spline_panels[1]);
     
     
     setup_raytrace_camera();
     
-    /*use points to draw each pixel*/
-    glBegin(GL_POINTS);
-    
-    /*color every pixel from the computed scene*/
-    for(y = 0; y < CANVAS_HEIGHT; ++y){
-        for(x = 0; x < CANVAS_WIDTH; ++x) {
-            color_pixel(x - my_width/2, 
-                        y - my_height/2, canvas[y*CANVAS_WIDTH + x]);
-        }
+    /*send only the rows traced since the last redraw*/
+    if(take_dirty_rows(&the_renderer, &first, &last)){
+        upload_rows(first, last);
     }
-    glEnd();
+    draw_canvas();
     
+    if(atomic_load(&render_running)){
+        draw_progress(render_progress(&the_renderer));
+    }
     
     if(show_message){
         glViewport(view_port_start, 0, 
-                    CANVAS_WIDTH+view_port_start, CANVAS_HEIGHT);
+                    canvas_width+view_port_start, canvas_height);
         glMatrixMode(GL_PROJECTION);
         glPushMatrix();
         glLoadIdentity();
@@ -386,105 +493,143 @@ void display_func(){
     glutSwapBuffers();
     glFinish();
     
+    phase_end(&the_renderer.times, PHASE_DISPLAY, start);
+}
+
+
+/*the body of the render thread*/
+void * render_main(void * arg){
+    compute_scene_progressive(&the_renderer, &the_scene);
+    atomic_store(&render_running, false);
+    return NULL;
+}
+
+/*redraws the partial image until the render is done*/
+void redraw_timer(int value){
+    glutPostRedisplay();
+    if(atomic_load(&render_running)){
+        glutTimerFunc(REDRAW_INTERVAL, redraw_timer, 0);
+    } else {
+        redraw_armed = false;
+    }
+}
+
+/*cancels the background render, if any, and waits for it to stop so the
+ * scene can be changed*/
+void stop_render(){
+    if(render_started){
+        cancel_render(&the_renderer);
+        pthread_join(render_thread, NULL);
+        render_started = false;
+    }
 }
 
+/*renders the scene on a background thread, cancelling the last render*/
+void start_render(){
+    stop_render();
+    atomic_store(&the_renderer.cancel, false);
+    atomic_store(&render_running, true);
+    if(pthread_create(&render_thread, NULL, render_main, NULL) == 0){
+        render_started = true;
+    } else {
+        /*no thread to be had, block the window instead*/
+        render_main(NULL);
+    }
+    if(!redraw_armed){
+        redraw_armed = true;
+        glutTimerFunc(REDRAW_INTERVAL, redraw_timer, 0);
+    }
+}
 
 bool light_toogle = false;
 /*keyboard callback handler*/
 void keyboard_input(unsigned char key, int x, int y){
     
     if(key == 'L' || key == 'l'){
+        /*the render in flight reads the light*/
+        stop_render();
         
-        light0.location.x = light0.location.x > 10 ? 0 : 20 ;
+        the_scene.light0.location.x = light_home_x + (light_toogle ? 0 : LIGHT_SHIFT);
         glDisable(light_toogle ? GL_LIGHT1 : GL_LIGHT0);
         glEnable(light_toogle ? GL_LIGHT0 : GL_LIGHT1);
         light_toogle = !light_toogle;
         
-        if(!show_message){
-            compute_scene(-SCENE_WIDTH/2,-SCENE_HEIGHT/2,
-                            SCENE_WIDTH/2,SCENE_HEIGHT/2);
+        /*only the light moved, so the last full render's hits still
+         * hold and just need shading again*/
+        if(!show_message && !reshade_scene(&the_renderer, &the_scene)){
+            start_render();
         }
         
         glutPostRedisplay();
+    } else if(key == 'S' || key == 's'){
+        /*the workers' counts are only read between renders*/
+        if(atomic_load(&render_running)){
+            fprintf(stderr, "still rendering, press S again when it is done\n");
+        } else {
+            print_render_stats(stdout, &the_renderer, stats_json);
+        }
     } else if(key == 'X' || key == 'x'){
+        stop_render();
+        if(stats_at_exit){
+            print_render_stats(stdout, &the_renderer, stats_json);
+        }
         exit(0);
     } else if(key == 'G' || key == 'g'){
-        compute_scene(-SCENE_WIDTH/2,-SCENE_HEIGHT/2,
-                        SCENE_WIDTH/2,SCENE_HEIGHT/2);
+        start_render();
         show_message = false;
         glutPostRedisplay();
     }
     
 }
 
-/* Add a sphere to the head of the list */
-void add_sphere(double x, double y, double z, double r, color c, 
-        double reflectivity, double spec_exp){
-    sphere_list * newNode = (sphere_list *) malloc(sizeof(sphere_list));
-    newNode->s.center.x = x;
-    newNode->s.center.y = y;
-    newNode->s.center.z = z;
-    newNode->s.radius = r;
-    newNode->ambient = c;
-    newNode->diffuse = c;
-    newNode->specular = c;
-    newNode->s_exp = spec_exp;
-    newNode->reflectivity = reflectivity;
-    newNode->next = list;
-    list = newNode;
-    
-}
-
 #define canvas_Width SCENE_WIDTH
 #define canvas_Height SCENE_HEIGHT
 #define canvas_Name "Programming Assignment 5 - Paul Warnes"
 
 
 int main(int argc, char ** argv){
-    int y, x;
-    /*setup some colors*/
-    color green = {GREEN};
-    color silver = {.4,.4,.4, 1.0};
-    color white = {.95,.95,.95, 1.0};
-    color orange = {ORANGE};
-    color red = {RED};
-    color yellow = {YELLOW};
-    color blue = {BLUE};
+    struct timespec setup;
+    render_options opts;
+    light scene_light;
+
+    default_options(&opts);
+    opts.hit_cache = true;
+    if(!parse_options(argc, argv, &opts, true)){
+        print_usage(argv[0]);
+        return 2;
+    }
+    /*no window (and no display connection) needed to render to a file*/
+    if(opts.headless){
+        /*a single render has no use for its hits afterwards*/
+        opts.hit_cache = false;
+        return run_headless(&opts);
+    }
+
     glutInit(&argc, argv);
     
-    glEnable(GL_AUTO_NORMAL);
     glShadeModel(GL_SMOOTH);
     
-    /*create the light*/
-    light0.location.x = 0;
-    light0.location.y = 0;
-    light0.location.z = 10;
-
-    light0.ambient.r = .12;
-    light0.ambient.g = .12;
-    light0.ambient.b = .12;
-    
-    light0.diffuse.r = .32;
-    light0.diffuse.g = .32;
-    light0.diffuse.b = .32;
-    
-    light0.specular.r = .4;
-    light0.specular.g = .4;
-    light0.specular.b = .4;
-    
-    add_sphere(0,0,-20,6, silver, 0.7, 9);
-    add_sphere(15,15,-20,7, white, 0.5, 1.4);
-    add_sphere(78,52,-70,10, green, 0.5, 1.2);
-    add_sphere(48,51,-68,10, red, 0.5, 1.1);
-    add_sphere(50,50,-40,4, yellow, 0.5, 1.2);
-    
-    add_sphere(-9,11,-11,10, orange, 0.5, 1.2);
-    
-    add_sphere(3,11,-11,2, red, 0.5, 1.2);
-    add_sphere(-50,0,-50,25, yellow, 0.5, 1.2);
-    add_sphere(45,5,20,18, blue, 0.5, 1.2);
-    
-    my_setup(CANVAS_WIDTH + SPLINE_WIDTH, CANVAS_HEIGHT, canvas_Name);
+    setup = phase_start();
+    if(opts.scene_file == NULL){
+        setup_scene(&the_scene);
+    } else if(!load_scene(&the_scene, opts.scene_file)){
+        return 1;
+    }
+    configure_scene(&the_scene, &opts);
+    init_renderer(&the_renderer, &opts);
+    canvas_width = the_renderer.canvas.width;
+    canvas_height = the_renderer.canvas.height;
+    phase_end(&the_renderer.times, PHASE_SETUP, setup);
+    atomic_init(&render_running, false);
+    stats_at_exit = opts.stats;
+    stats_json = opts.stats_json;
+    
+    spline_u = opts.spline_u;
+    spline_v = opts.spline_v;
+    
+    my_setup(canvas_width + SPLINE_WIDTH, canvas_height, canvas_Name);
+    init_canvas_texture();
+    init_spline_panels();
     
     glutKeyboardFunc(keyboard_input);
     
@@ -493,19 +638,22 @@ int main(int argc, char ** argv){
     /*setup the light for splines*/
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluOrtho2D((GLdouble) -(CANVAS_WIDTH + SPLINE_WIDTH)/2, 
-               (GLdouble) (CANVAS_WIDTH + SPLINE_WIDTH)/2, 
-               (GLdouble) -CANVAS_HEIGHT/2, (GLdouble) CANVAS_HEIGHT/2);
+    gluOrtho2D((GLdouble) -(canvas_width + SPLINE_WIDTH)/2, 
+               (GLdouble) (canvas_width + SPLINE_WIDTH)/2, 
+               (GLdouble) -canvas_height/2, (GLdouble) canvas_height/2);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
-    light0.location.y = SCENE_HEIGHT/2;
-    light0.location.x = CANVAS_WIDTH/2 + SPLINE_WIDTH/2;
-    init_light(GL_LIGHT0, light0);
-    light0.location.x += 20;
-    init_light(GL_LIGHT1, light0);
+    /*the spline lights share the scene light's colors but sit by the
+     * panels, the ray traced light stays where the scene put it*/
+    scene_light = the_scene.light0;
+    the_scene.light0.location.y = SCENE_HEIGHT/2;
+    the_scene.light0.location.x = canvas_width/2 + SPLINE_WIDTH/2;
+    init_light(GL_LIGHT0, the_scene.light0);
+    the_scene.light0.location.x += LIGHT_SHIFT;
+    init_light(GL_LIGHT1, the_scene.light0);
     glEnable(GL_LIGHT0);
-    light0.location.x = 0;
-    light0.location.y = 0;
+    the_scene.light0 = scene_light;
+    light_home_x = scene_light.location.x;
     
     glutMainLoop();
     
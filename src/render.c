@@ -0,0 +1,859 @@
+/*********************
+ * Tiled, multi-threaded driver for cast_ray.
+ *
+ * compute_scene - traces every pixel of canvas, a tile at a time
+ * compute_scene_progressive - traces canvas in passes of shrinking
+ *                  blocks so a usable image shows up early
+ * render_tile - traces the pixels of one tile
+ * render_tile_wavefront - traces the pixels of one tile breadth first
+ * reshade_scene - recolors canvas for a new light from the hit cache
+ * trace_band - traces some rows of tiles into a buffer of their own, for
+ *                  a farm worker
+ * stream_scene - traces a band of tiles at a time and hands the bands to
+ *                  an encoder thread that writes them out in order
+ * encode_bands - the encoder thread of stream_scene
+ * antialias - supersamples the pixels on edges once a frame is traced
+ *
+ * A pass of stride s traces every s-th pixel of every s-th row of a tile
+ * and paints the s x s block below and right of it, skipping the pixels
+ * the previous pass (of stride 2s) already traced. The last pass has
+ * stride 1, so every pixel ends up traced exactly once.
+ *
+ * Anti-aliasing then finds the pixels whose neighbours hit another sphere
+ * first or differ too much in color, and replaces each with the mean of
+ * four samples at the centers of its quarters, splitting again the
+ * quarters that disagree until aa_levels levels are used up. Flat areas
+ * keep their single ray.
+ */
+#include "render.h"
+#include "gbuffer.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*the bands of a streamed render on their way to the encoder. Band b,
+ * counted from the top of the image, is traced into slot b % slot_count,
+ * which is free again once the encoder has written band b - slot_count,
+ * so only slot_count bands are ever held however big the image*/
+typedef struct band_ring_struct {
+    color ** slots;         /*tile_size rows of stride colors each*/
+    int slot_count;
+    int bands;              /*in the image, one per row of tiles*/
+    atomic_int * remaining; /*tiles of each slot's band not yet traced*/
+    bool * traced;          /*slots holding a band waiting to be written*/
+    int written;            /*bands the encoder has written*/
+    bool failed;            /*the encoder could not write*/
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    image_writer * out;
+    const framebuffer * canvas;
+    int tile_size;
+} band_ring;
+
+/*the parameters of one compute_scene call shared by its tiles*/
+typedef struct frame_job_struct {
+    const scene * sc;
+    framebuffer * canvas;
+    wavefront * waves;
+    double x1, y1;
+    int tile_size, tiles_x;
+    int packet_size;
+    int stride;     /*distance between the pixels traced by this pass*/
+    int coarser;    /*stride of the pass before, 0 for the first*/
+    gbuffer * hits;     /*NULL unless hits are cached*/
+    band_ring * ring;   /*NULL unless the render is streamed*/
+    int first_band;     /*of the pool run when streamed*/
+    /*where the tiles go when not streamed: the canvas, or the band
+     * trace_band was given, whose first tile is first_tile*/
+    color * band;
+    int first_tile;
+    const sphere_list ** first_hits;    /*NULL unless anti-aliasing*/
+    unsigned char * refine;
+    int aa_levels;
+    int aa_seed;        /*first seed of the anti-aliasing tracers*/
+    atomic_bool * cancel;
+    atomic_int * tiles_done;
+    _Atomic uint64_t * dirty_rows;
+    worker_stats * stats;
+    double width_ratio, height_ratio;
+} frame_job;
+
+/*allocates a cache line aligned canvas of width x height, black. With
+ * allocate unset only the sizes are filled in, for a streamed render*/
+static void init_framebuffer(framebuffer * fb, int width, int height, bool allocate){
+    size_t size;
+    fb->width = width;
+    fb->height = height;
+    fb->stride = (width + COLORS_PER_LINE - 1) / COLORS_PER_LINE * COLORS_PER_LINE;
+    fb->pixels = NULL;
+    if(!allocate){
+        return;
+    }
+    size = sizeof(color) * fb->stride * height;
+    fb->pixels = aligned_alloc(64, size);
+    memset(fb->pixels, 0, size);
+}
+
+/*gives rd a hit cache of depth hits for each of pixels, or none when
+ * there is not the memory for it: a light move then traces the scene
+ * again instead of re-shading*/
+static void make_hit_cache(renderer * rd, int pixels, int depth){
+    rd->hits = malloc(sizeof(gbuffer));
+    if(rd->hits == NULL || !init_gbuffer(rd->hits, pixels, depth)){
+        fprintf(stderr, "no memory for a hit cache of %d pixels at depth %d, "
+                "light moves trace the scene again\n", pixels, depth);
+        free(rd->hits);
+        rd->hits = NULL;
+    }
+}
+
+void init_renderer(renderer * rd, const render_options * opts){
+    /*neither a streamed render nor a farm worker keeps a whole frame*/
+    bool streamed = opts->headless && (opts->stream || opts->worker != NULL);
+    int n;
+    if(select_kernel(opts->kernel) == NULL){
+        fprintf(stderr, "kernel %s is not available, using %s\n", opts->kernel,
+                select_kernel(NULL));
+    }
+    rd->pool = create_pool(opts->threads);
+    init_framebuffer(&rd->canvas, opts->width, opts->height, !streamed);
+    rd->tile_size = opts->tile_size > 0 ? opts->tile_size : DEFAULT_TILE_SIZE;
+    rd->packet_size = opts->packet_size > 0 ? opts->packet_size : 1;
+    rd->engine = opts->wavefront ? ENGINE_WAVEFRONT : ENGINE_RECURSIVE;
+    rd->waves = NULL;
+    rd->hits = NULL;
+    if(opts->hit_cache && !streamed){
+        make_hit_cache(rd, rd->canvas.stride * rd->canvas.height, opts->max_depth);
+    }
+    rd->aa_levels = 0;
+    for(n = opts->aa; n > 1 && !streamed; n /= 4){
+        ++rd->aa_levels;
+    }
+    rd->first_hits = NULL;
+    rd->refine = NULL;
+    if(rd->aa_levels > 0){
+        rd->first_hits = malloc(sizeof(sphere_list *) * rd->canvas.stride * rd->canvas.height);
+        rd->refine = malloc((size_t)rd->canvas.stride * rd->canvas.height);
+    }
+    atomic_init(&rd->cancel, false);
+    atomic_init(&rd->tiles_done, 0);
+    atomic_init(&rd->tiles_total, 0);
+    atomic_init(&rd->dirty_rows, 0);
+    rd->stats = aligned_alloc(_Alignof(worker_stats),
+            sizeof(worker_stats) * pool_threads(rd->pool));
+    reset_render_stats(rd);
+    memset(&rd->times, 0, sizeof(phase_times));
+}
+
+/*sizes the canvas, and the buffers of hits and anti-aliasing that go
+ * with it, for width x height, keeping the pool and threads. Nothing
+ * changes when the size does not; the new canvas is black*/
+void resize_renderer(renderer * rd, int width, int height){
+    bool allocate = rd->canvas.pixels != NULL;
+    size_t pixels;
+    if(rd->canvas.width == width && rd->canvas.height == height){
+        return;
+    }
+    free(rd->canvas.pixels);
+    init_framebuffer(&rd->canvas, width, height, allocate);
+    pixels = (size_t)rd->canvas.stride * height;
+    if(rd->hits != NULL){
+        int depth = rd->hits->depth;
+        free_gbuffer(rd->hits);
+        free(rd->hits);
+        make_hit_cache(rd, (int)pixels, depth);
+    }
+    if(rd->aa_levels > 0){
+        free(rd->first_hits);
+        free(rd->refine);
+        rd->first_hits = malloc(sizeof(sphere_list *) * pixels);
+        rd->refine = malloc(pixels);
+    }
+}
+
+/*copies the tracing options that live in the scene, and sets the camera
+ * to the requested extent or, without one, widens or narrows it about
+ * its center so the image's pixels stay square*/
+void configure_scene(scene * sc, const render_options * opts){
+    double cx = (sc->view.x1 + sc->view.x2) / 2, cy = (sc->view.y1 + sc->view.y2) / 2;
+    double w = sc->view.x2 - sc->view.x1, h = sc->view.y2 - sc->view.y1;
+
+    sc->use_bvh = opts->use_bvh;
+    sc->shadows = opts->shadows;
+    sc->occluder_cache = opts->occluder_cache;
+    sc->use_light_grid = opts->use_light_grid;
+    sc->max_ray_depth = opts->max_depth;
+    sc->min_weight = opts->min_weight;
+    sc->roulette = opts->roulette;
+
+    if(opts->extent_width > 0){
+        w = opts->extent_width;
+        h = opts->extent_height;
+    } else if(w * opts->height != h * opts->width){
+        w = h * opts->width / opts->height;
+    } else {
+        return;
+    }
+    sc->view.x1 = cx - w / 2;
+    sc->view.x2 = cx + w / 2;
+    sc->view.y1 = cy - h / 2;
+    sc->view.y2 = cy + h / 2;
+}
+
+/*frees the threads' wavefronts, if any*/
+static void free_waves(renderer * rd){
+    int i;
+    if(rd->waves != NULL){
+        for(i = 0; i < pool_threads(rd->pool); ++i){
+            free_wavefront(&rd->waves[i]);
+        }
+        free(rd->waves);
+        rd->waves = NULL;
+    }
+}
+
+void destroy_renderer(renderer * rd){
+    free_waves(rd);
+    if(rd->hits != NULL){
+        free_gbuffer(rd->hits);
+        free(rd->hits);
+        rd->hits = NULL;
+    }
+    free(rd->first_hits);
+    free(rd->refine);
+    rd->first_hits = NULL;
+    rd->refine = NULL;
+    free(rd->stats);
+    rd->stats = NULL;
+    free(rd->canvas.pixels);
+    rd->canvas.pixels = NULL;
+    destroy_pool(rd->pool);
+    rd->pool = NULL;
+}
+
+/*the pixel range [x_start, x_end) x [y_start, y_end) of a tile*/
+static void tile_bounds(const frame_job * job, int tile, int * x_start, int * y_start,
+        int * x_end, int * y_end){
+    *x_start = (tile % job->tiles_x) * job->tile_size;
+    *y_start = (tile / job->tiles_x) * job->tile_size;
+    *x_end = *x_start + job->tile_size;
+    *y_end = *y_start + job->tile_size;
+    if(*x_end > job->canvas->width){
+        *x_end = job->canvas->width;
+    }
+    if(*y_end > job->canvas->height){
+        *y_end = job->canvas->height;
+    }
+}
+
+/*turns the tile-th tile of a pool run into the frame's tile number, and
+ * finds the buffer its pixels go to: the canvas or trace_band's band, or
+ * the slot of its band when streamed. Pixel (x, y) of the tile is
+ * out[(y - row0)*stride + x]*/
+static int locate_tile(const frame_job * job, int tile, color ** out, int * row0){
+    int band, row;
+    if(job->ring == NULL){
+        *out = job->band;
+        *row0 = job->first_tile / job->tiles_x * job->tile_size;
+        return job->first_tile + tile;
+    }
+    band = job->first_band + tile / job->tiles_x;
+    row = job->ring->bands - 1 - band;
+    *out = job->ring->slots[band % job->ring->slot_count];
+    *row0 = row * job->tile_size;
+    return row * job->tiles_x + tile % job->tiles_x;
+}
+
+/*counts a traced tile of a streamed render, waking the encoder when it
+ * was the last of its band*/
+static void band_traced(band_ring * ring, int tile_row){
+    int slot = (ring->bands - 1 - tile_row) % ring->slot_count;
+    if(atomic_fetch_sub(&ring->remaining[slot], 1) == 1){
+        pthread_mutex_lock(&ring->lock);
+        ring->traced[slot] = true;
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+/*the primary ray through pixel (x, y), or through a point between pixels
+ * for anti-aliasing*/
+static ray primary_ray(const frame_job * job, double x, double y){
+    ray r;
+    r.orgin.z = 0.0;
+    r.at.z = -1.0;
+    r.orgin.x = r.at.x = x*job->width_ratio + job->x1;
+    r.orgin.y = r.at.y = y*job->height_ratio + job->y1;
+    return r;
+}
+
+/*adds the rows [first, last) to a dirty range*/
+static void mark_dirty(_Atomic uint64_t * dirty, uint32_t first, uint32_t last){
+    uint64_t r = atomic_load(dirty), merged;
+    do {
+        uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+        if(lo < hi){
+            first = first < lo ? first : lo;
+            last = last > hi ? last : hi;
+        }
+        merged = ((uint64_t)last << 32) | first;
+    } while(merged != r && !atomic_compare_exchange_weak(dirty, &r, merged));
+}
+
+/*whether the pixel dx, dy into its tile was traced by the previous pass*/
+static bool traced_before(const frame_job * job, int dx, int dy){
+    return job->coarser > 0 && dx % job->coarser == 0 && dy % job->coarser == 0;
+}
+
+/*paints the stride x stride block at (x, y), cut at the tile's edge, with
+ * the color traced for its corner*/
+static void fill_block(const frame_job * job, int x, int y, int x_end, int y_end){
+    color * pixels = job->canvas->pixels;
+    int stride = job->canvas->stride, bx, by;
+    color c = pixels[y*stride + x];
+    for(by = y; by < y + job->stride && by < y_end; ++by){
+        for(bx = x; bx < x + job->stride && bx < x_end; ++bx){
+            pixels[by*stride + bx] = c;
+        }
+    }
+}
+
+/*cast rays out of the pixels of the given tile this pass traces, in
+ * packets of up to packet_size x packet_size of them*/
+static void render_tile(void * arg, int tile, int worker){
+    const frame_job * job = arg;
+    int x, y, px, py, n, i;
+    int x_start, y_start, x_end, y_end;
+    int span = job->packet_size * job->stride;
+    int pixels[MAX_PACKET];
+    ray rays[MAX_PACKET];
+    color colors[MAX_PACKET], * out;
+    int row0;
+    tracer tr;
+
+    if(atomic_load_explicit(job->cancel, memory_order_relaxed)){
+        return;
+    }
+    tile = locate_tile(job, tile, &out, &row0);
+    /*seeded by tile so a frame does not depend on which thread ran what*/
+    init_tracer(&tr, job->sc, tile);
+    tr.first_pixel = (size_t)row0 * job->canvas->stride;
+    tr.cache = job->hits;
+    tr.first_hit = job->first_hits;
+    tile_bounds(job, tile, &x_start, &y_start, &x_end, &y_end);
+
+    for(y = y_start; y < y_end; y += span){
+        for(x = x_start; x < x_end; x += span){
+            n = 0;
+            for(py = y; py < y + span && py < y_end; py += job->stride){
+                for(px = x; px < x + span && px < x_end; px += job->stride){
+                    if(!traced_before(job, px - x_start, py - y_start)){
+                        pixels[n] = (py - row0)*job->canvas->stride + px;
+                        gbuffer_clear(job->hits, pixels[n]);
+                        if(job->first_hits != NULL){
+                            job->first_hits[pixels[n]] = NULL;
+                        }
+                        rays[n++] = primary_ray(job, px, py);
+                    }
+                }
+            }
+
+            if(n == 1){
+                tr.pixel = pixels[0];
+                colors[0] = cast_ray(&tr, rays[0], 0, 1.0);
+            } else if(n > 1){
+                cast_packet(&tr, rays, pixels, n, colors);
+            }
+
+            for(i = 0; i < n; ++i){
+                out[pixels[i]] = colors[i];
+                if(job->stride > 1){
+                    fill_block(job, pixels[i] % job->canvas->stride,
+                            pixels[i] / job->canvas->stride, x_end, y_end);
+                }
+            }
+        }
+    }
+    mark_dirty(job->dirty_rows, y_start, y_end);
+    add_stats(&job->stats[worker].s, &tr.stats);
+    atomic_fetch_add_explicit(job->tiles_done, 1, memory_order_relaxed);
+    if(job->ring != NULL){
+        band_traced(job->ring, tile / job->tiles_x);
+    }
+}
+
+/*traces the pixels of the given tile this pass traces with the worker's
+ * wavefront*/
+static void render_tile_wavefront(void * arg, int tile, int worker){
+    const frame_job * job = arg;
+    wavefront * wf = &job->waves[worker];
+    int x, y, n = 0;
+    int x_start, y_start, x_end, y_end, row0;
+    color * out;
+    tracer tr;
+
+    if(atomic_load_explicit(job->cancel, memory_order_relaxed)){
+        return;
+    }
+    tile = locate_tile(job, tile, &out, &row0);
+    init_tracer(&tr, job->sc, tile);
+    tr.first_pixel = (size_t)row0 * job->canvas->stride;
+    tr.cache = job->hits;
+    tr.first_hit = job->first_hits;
+    tile_bounds(job, tile, &x_start, &y_start, &x_end, &y_end);
+    for(y = y_start; y < y_end; y += job->stride){
+        for(x = x_start; x < x_end; x += job->stride){
+            if(!traced_before(job, x - x_start, y - y_start)){
+                wf->current[n].r = primary_ray(job, x, y);
+                wf->current[n].weight = 1.0;
+                wf->current[n++].pixel = (y - row0)*job->canvas->stride + x;
+            }
+        }
+    }
+    trace_wavefront(wf, &tr, n, out);
+
+    /*the queue is reordered as it is traced, so walk the pixels again*/
+    if(job->stride > 1){
+        for(y = y_start; y < y_end; y += job->stride){
+            for(x = x_start; x < x_end; x += job->stride){
+                if(!traced_before(job, x - x_start, y - y_start)){
+                    fill_block(job, x, y, x_end, y_end);
+                }
+            }
+        }
+    }
+    mark_dirty(job->dirty_rows, y_start, y_end);
+    add_stats(&job->stats[worker].s, &tr.stats);
+    atomic_fetch_add_explicit(job->tiles_done, 1, memory_order_relaxed);
+    if(job->ring != NULL){
+        band_traced(job->ring, tile / job->tiles_x);
+    }
+}
+
+/*sets up job for a frame of the scene's view, returning its tile count*/
+static int start_frame(renderer * rd, const scene * sc, frame_job * job){
+    int i, tiles_y;
+    /*a tile holds at most the canvas*/
+    size_t capacity = (size_t)(rd->tile_size < rd->canvas.width ? rd->tile_size
+            : rd->canvas.width) * (rd->tile_size < rd->canvas.height ? rd->tile_size
+            : rd->canvas.height);
+
+    job->sc = sc;
+    job->canvas = &rd->canvas;
+    job->x1 = sc->view.x1;
+    job->y1 = sc->view.y1;
+    job->tile_size = rd->tile_size;
+    job->packet_size = rd->packet_size;
+    job->tiles_x = (rd->canvas.width + rd->tile_size - 1) / rd->tile_size;
+    tiles_y = (rd->canvas.height + rd->tile_size - 1) / rd->tile_size;
+    job->height_ratio = (sc->view.y2 - sc->view.y1)/rd->canvas.height;
+    job->width_ratio = (sc->view.x2 - sc->view.x1)/rd->canvas.width;
+    job->hits = rd->hits;
+    job->ring = NULL;
+    job->first_band = 0;
+    job->band = rd->canvas.pixels;
+    job->first_tile = 0;
+    job->first_hits = rd->first_hits;
+    job->refine = rd->refine;
+    job->aa_levels = rd->aa_levels;
+    job->aa_seed = job->tiles_x * tiles_y;
+    job->cancel = &rd->cancel;
+    job->dirty_rows = &rd->dirty_rows;
+    job->stats = rd->stats;
+    job->tiles_done = &rd->tiles_done;
+
+    /*a resized canvas may have grown past the tiles they were sized for*/
+    if(rd->waves != NULL && rd->waves[0].capacity < capacity){
+        free_waves(rd);
+    }
+    if(rd->engine == ENGINE_WAVEFRONT && rd->waves == NULL){
+        rd->waves = malloc(sizeof(wavefront) * pool_threads(rd->pool));
+        for(i = 0; i < pool_threads(rd->pool); ++i){
+            init_wavefront(&rd->waves[i], capacity);
+        }
+    }
+    job->waves = rd->waves;
+    return job->tiles_x * tiles_y;
+}
+
+/*whether two colors are within AA_CONTRAST in every channel*/
+static bool colors_close(color a, color b){
+    return fabsf(a.r - b.r) <= AA_CONTRAST && fabsf(a.g - b.g) <= AA_CONTRAST
+        && fabsf(a.b - b.b) <= AA_CONTRAST;
+}
+
+/*whether pixel (x, y) lies on an edge: a neighbour's primary ray hit
+ * another sphere first or its color is too far off*/
+static bool on_edge(const frame_job * job, int x, int y){
+    static const int dx[4] = {1, -1, 0, 0}, dy[4] = {0, 0, 1, -1};
+    const framebuffer * fb = job->canvas;
+    int p = y*fb->stride + x, q, k;
+
+    for(k = 0; k < 4; ++k){
+        if(x + dx[k] < 0 || x + dx[k] >= fb->width
+                || y + dy[k] < 0 || y + dy[k] >= fb->height){
+            continue;
+        }
+        q = p + dy[k]*fb->stride + dx[k];
+        if(job->first_hits[q] != job->first_hits[p]
+                || !colors_close(fb->pixels[q], fb->pixels[p])){
+            return true;
+        }
+    }
+    return false;
+}
+
+/*flags the pixels of a tile that are on an edge*/
+static void mark_tile(void * arg, int tile, int worker){
+    const frame_job * job = arg;
+    int x, y, x_start, y_start, x_end, y_end;
+
+    tile_bounds(job, tile, &x_start, &y_start, &x_end, &y_end);
+    for(y = y_start; y < y_end; ++y){
+        for(x = x_start; x < x_end; ++x){
+            job->refine[y*job->canvas->stride + x] = on_edge(job, x, y);
+        }
+    }
+}
+
+/*the color of the square of edge size (in pixels) centered on (x, y):
+ * the mean of samples at the centers of its quarters, each quarter split
+ * the same way while they disagree and levels remain*/
+static color supersample(const frame_job * job, tracer * tr, double x, double y,
+        double size, int levels){
+    const sphere_list * hits[4];
+    color c[4], mean = {BLACK};
+    double q = size / 4;
+    bool split = false;
+    int k;
+
+    tr->first_hit = hits;
+    for(k = 0; k < 4; ++k){
+        tr->pixel = k;
+        /*the samples share pixel numbers, so each moves the roulette's
+         * seed on*/
+        tracer_random(tr);
+        hits[k] = NULL;
+        c[k] = cast_ray(tr, primary_ray(job, x + (k & 1 ? q : -q), y + (k & 2 ? q : -q)),
+                0, 1.0);
+    }
+    tr->stats.aa_rays += 4;
+    for(k = 1; k < 4; ++k){
+        split = split || hits[k] != hits[0] || !colors_close(c[k], c[0]);
+    }
+    for(k = 0; k < 4; ++k){
+        if(split && levels > 1){
+            c[k] = supersample(job, tr, x + (k & 1 ? q : -q), y + (k & 2 ? q : -q),
+                    size / 2, levels - 1);
+        }
+        mean.r += c[k].r / 4;
+        mean.g += c[k].g / 4;
+        mean.b += c[k].b / 4;
+    }
+    return mean;
+}
+
+/*replaces the flagged pixels of a tile with their supersampled colors*/
+static void antialias_tile(void * arg, int tile, int worker){
+    const frame_job * job = arg;
+    int x, y, p, x_start, y_start, x_end, y_end;
+    bool changed = false;
+    tracer tr;
+
+    if(atomic_load_explicit(job->cancel, memory_order_relaxed)){
+        return;
+    }
+    /*seeded apart from the tiles' first rays*/
+    init_tracer(&tr, job->sc, job->aa_seed + tile);
+    tile_bounds(job, tile, &x_start, &y_start, &x_end, &y_end);
+    for(y = y_start; y < y_end; ++y){
+        for(x = x_start; x < x_end; ++x){
+            p = y*job->canvas->stride + x;
+            if(job->refine[p]){
+                job->canvas->pixels[p] = supersample(job, &tr, x, y, 1, job->aa_levels);
+                changed = true;
+            }
+        }
+    }
+    if(changed){
+        mark_dirty(job->dirty_rows, y_start, y_end);
+    }
+    add_stats(&job->stats[worker].s, &tr.stats);
+}
+
+/*supersamples the pixels on edges of a traced frame, nothing unless the
+ * renderer anti-aliases. Every pixel is flagged before any is changed, so
+ * the result does not depend on the order of the tiles*/
+static void antialias(renderer * rd, frame_job * job, int tiles){
+    if(rd->aa_levels == 0 || atomic_load(&rd->cancel)){
+        return;
+    }
+    pool_run(rd->pool, tiles, mark_tile, job);
+    pool_run(rd->pool, tiles, antialias_tile, job);
+}
+
+/*runs one pass of stride over every tile of job*/
+static void run_pass(renderer * rd, frame_job * job, int tiles, int stride, int coarser){
+    job->stride = stride;
+    job->coarser = coarser;
+    pool_run(rd->pool, tiles, rd->engine == ENGINE_WAVEFRONT
+            ? render_tile_wavefront : render_tile, job);
+}
+
+/*cast rays out of every pixel of the scene's view*/
+void compute_scene(renderer * rd, const scene * sc){
+    struct timespec start = phase_start();
+    frame_job job;
+    int tiles = start_frame(rd, sc, &job);
+
+    atomic_store(&rd->cancel, false);
+    atomic_store(&rd->tiles_done, 0);
+    atomic_store(&rd->tiles_total, tiles);
+    if(rd->hits != NULL){
+        rd->hits->valid = false;
+    }
+    run_pass(rd, &job, tiles, 1, 0);
+    antialias(rd, &job, tiles);
+    if(rd->hits != NULL){
+        rd->hits->valid = true;
+    }
+    phase_end(&rd->times, PHASE_RENDER, start);
+}
+
+/*traces the rows of tiles [first, first + count), counted from the
+ * bottom, into band: the image rows from first * tile_size up, cut at
+ * the top of the image, stride colors apart and bottom first. The canvas
+ * is left alone, so rd may be sized only. Tiles are seeded by their place
+ * in the frame, so the pixels are the ones compute_scene traces there*/
+void trace_band(renderer * rd, const scene * sc, int first, int count, color * band){
+    struct timespec start = phase_start();
+    frame_job job;
+
+    start_frame(rd, sc, &job);
+    job.band = band;
+    job.first_tile = first * job.tiles_x;
+    atomic_store(&rd->cancel, false);
+    run_pass(rd, &job, count * job.tiles_x, 1, 0);
+    phase_end(&rd->times, PHASE_RENDER, start);
+}
+
+/*cast rays out of every pixel of the scene's view, coarse blocks first.
+ * Meant to run on its own thread while another shows canvas. rd->cancel
+ * is left as the caller set it, so a cancel_render made before the thread
+ * got going is not lost; returns false if it stopped the render early*/
+bool compute_scene_progressive(renderer * rd, const scene * sc){
+    struct timespec start = phase_start();
+    frame_job job;
+    int tiles = start_frame(rd, sc, &job);
+    int stride, passes = 0;
+    bool done;
+
+    for(stride = PROGRESSIVE_START; stride >= 1; stride /= 2){
+        ++passes;
+    }
+    atomic_store(&rd->tiles_done, 0);
+    atomic_store(&rd->tiles_total, tiles * passes);
+    if(rd->hits != NULL){
+        rd->hits->valid = false;
+    }
+
+    for(stride = PROGRESSIVE_START; stride >= 1 && !atomic_load(&rd->cancel); stride /= 2){
+        run_pass(rd, &job, tiles, stride, stride == PROGRESSIVE_START ? 0 : stride * 2);
+    }
+    antialias(rd, &job, tiles);
+    done = !atomic_load(&rd->cancel);
+    if(done && rd->hits != NULL){
+        rd->hits->valid = true;
+    }
+    phase_end(&rd->times, PHASE_RENDER, start);
+    return done;
+}
+
+/*writes the bands of a streamed render in order as they are traced,
+ * freeing each slot once its band is out*/
+static void * encode_bands(void * arg){
+    band_ring * ring = arg;
+    int band, slot, row, rows;
+    bool ok = true;
+
+    for(band = 0; band < ring->bands && ok; ++band){
+        slot = band % ring->slot_count;
+        pthread_mutex_lock(&ring->lock);
+        while(!ring->traced[slot]){
+            pthread_cond_wait(&ring->changed, &ring->lock);
+        }
+        pthread_mutex_unlock(&ring->lock);
+
+        /*the top band is cut short when tiles do not divide the height*/
+        row = (ring->bands - 1 - band) * ring->tile_size;
+        rows = ring->canvas->height - row < ring->tile_size
+            ? ring->canvas->height - row : ring->tile_size;
+        ok = write_rows(ring->out, ring->slots[slot], rows, ring->canvas->stride);
+
+        pthread_mutex_lock(&ring->lock);
+        ring->traced[slot] = false;
+        ring->written = band + 1;
+        ring->failed = !ok;
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+    }
+    return NULL;
+}
+
+/*cast rays out of every pixel of the scene's view into out, without a
+ * canvas (rd must come from init_renderer with opts->stream). The tiles
+ * are traced a window of bands (rows of tiles) at a time, top first, while
+ * an encoder thread writes the bands already finished, so at most two
+ * windows of bands are held at once. Returns false if out could not be
+ * written*/
+bool stream_scene(renderer * rd, const scene * sc, image_writer * out){
+    struct timespec start = phase_start();
+    frame_job job;
+    band_ring ring;
+    pthread_t encoder;
+    int tiles = start_frame(rd, sc, &job);
+    int window = pool_threads(rd->pool), first, count, i;
+    bool failed = false;
+
+    ring.bands = tiles / job.tiles_x;
+    ring.slot_count = 2 * window < ring.bands ? 2 * window : ring.bands;
+    ring.slots = malloc(sizeof(color *) * ring.slot_count);
+    ring.remaining = malloc(sizeof(atomic_int) * ring.slot_count);
+    ring.traced = calloc(ring.slot_count, sizeof(bool));
+    for(i = 0; i < ring.slot_count; ++i){
+        ring.slots[i] = aligned_alloc(64,
+                sizeof(color) * rd->canvas.stride * rd->tile_size);
+        atomic_init(&ring.remaining[i], 0);
+    }
+    ring.written = 0;
+    ring.failed = false;
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.changed, NULL);
+    ring.out = out;
+    ring.canvas = &rd->canvas;
+    ring.tile_size = rd->tile_size;
+
+    atomic_store(&rd->cancel, false);
+    atomic_store(&rd->tiles_done, 0);
+    atomic_store(&rd->tiles_total, tiles);
+    job.ring = &ring;
+    job.stride = 1;
+    job.coarser = 0;
+    pthread_create(&encoder, NULL, encode_bands, &ring);
+
+    for(first = 0; first < ring.bands && !failed; first += count){
+        count = ring.bands - first < window ? ring.bands - first : window;
+        /*wait for the encoder to free the window's slots*/
+        pthread_mutex_lock(&ring.lock);
+        while(!ring.failed && ring.written < first + count - ring.slot_count){
+            pthread_cond_wait(&ring.changed, &ring.lock);
+        }
+        failed = ring.failed;
+        pthread_mutex_unlock(&ring.lock);
+
+        if(!failed){
+            for(i = first; i < first + count; ++i){
+                atomic_store(&ring.remaining[i % ring.slot_count], job.tiles_x);
+            }
+            job.first_band = first;
+            pool_run(rd->pool, count * job.tiles_x, rd->engine == ENGINE_WAVEFRONT
+                    ? render_tile_wavefront : render_tile, &job);
+        }
+    }
+    pthread_join(encoder, NULL);
+
+    for(i = 0; i < ring.slot_count; ++i){
+        free(ring.slots[i]);
+    }
+    free(ring.slots);
+    free(ring.remaining);
+    free(ring.traced);
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.changed);
+    phase_end(&rd->times, PHASE_RENDER, start);
+    return !ring.failed;
+}
+
+/*asks the render running on another thread to stop, tiles already
+ * started are finished*/
+void cancel_render(renderer * rd){
+    atomic_store(&rd->cancel, true);
+}
+
+/*the share of the current render's tiles traced so far, in [0, 1]*/
+double render_progress(renderer * rd){
+    int done = atomic_load_explicit(&rd->tiles_done, memory_order_relaxed);
+    int total = atomic_load_explicit(&rd->tiles_total, memory_order_relaxed);
+    return total > 0 ? done / (double)total : 0;
+}
+
+/*the parameters of one reshade_scene call shared by its rows*/
+typedef struct reshade_job_struct {
+    const gbuffer * hits;
+    const scene * sc;
+    framebuffer * canvas;
+    worker_stats * stats;
+} reshade_job;
+
+static void reshade_row(void * arg, int row, int worker){
+    const reshade_job * job = arg;
+    int first = row * job->canvas->stride;
+    shade_gbuffer(job->hits, job->sc, first, first + job->canvas->width,
+            job->canvas->pixels, &job->stats[worker].s);
+}
+
+/*recolors canvas for the current light of sc from the hits cached by the
+ * last complete render, without casting a ray but for anti-aliasing the
+ * edges again (the cache holds one path per pixel). Only valid when
+ * nothing but the light changed since; returns false, leaving canvas
+ * alone, if there is no such render to reuse*/
+bool reshade_scene(renderer * rd, const scene * sc){
+    struct timespec start = phase_start();
+    reshade_job job;
+    frame_job frame;
+    if(rd->hits == NULL || !rd->hits->valid){
+        return false;
+    }
+    job.hits = rd->hits;
+    job.sc = sc;
+    job.canvas = &rd->canvas;
+    job.stats = rd->stats;
+    pool_run(rd->pool, rd->canvas.height, reshade_row, &job);
+    atomic_store(&rd->cancel, false);
+    antialias(rd, &frame, start_frame(rd, sc, &frame));
+    mark_dirty(&rd->dirty_rows, 0, rd->canvas.height);
+    phase_end(&rd->times, PHASE_RESHADE, start);
+    return true;
+}
+
+/*hands out the rows of canvas written since the last call as [first,
+ * last) and forgets them; false if none were*/
+bool take_dirty_rows(renderer * rd, int * first, int * last){
+    uint64_t r = atomic_exchange(&rd->dirty_rows, 0);
+    *first = (uint32_t)r;
+    *last = (uint32_t)(r >> 32);
+    return *first < *last;
+}
+
+/*the counts of every worker since reset_render_stats, added up. Only
+ * meaningful while no render is running*/
+void render_stats(const renderer * rd, ray_stats * total){
+    int i;
+    memset(total, 0, sizeof(ray_stats));
+    for(i = 0; i < pool_threads(rd->pool); ++i){
+        add_stats(total, &rd->stats[i].s);
+    }
+}
+
+void reset_render_stats(renderer * rd){
+    memset(rd->stats, 0, sizeof(worker_stats) * pool_threads(rd->pool));
+}
+
+/*writes the summed counters and the phase times, as text or JSON*/
+void print_render_stats(FILE * out, const renderer * rd, bool json){
+    ray_stats total;
+    render_stats(rd, &total);
+    print_stats(out, &total, &rd->times, json);
+}
@@ -0,0 +1,609 @@
+/*********************
+ * The ray tracing half of the program, split out of raytracer.c so that
+ * it can be driven either by the GLUT viewer or by the headless renderer.
+ *
+ * phong_sphere - used to apply Phong Illumination to a sphere
+ * phong_hit - the same given the normal and view direction at the hit,
+ *                  through the shading routine append_sphere picked for
+ *                  the sphere's material
+ * light_hit - phong_hit under the scene's lights, leaving out those a
+ *                  sphere shadows the hit from
+ * add_light - adds a point light, build_scene must be called after
+ * cast_ray - apply the raycasting algorithm
+ * cast_packet - cast a bundle of parallel primary rays together
+ * add_sphere - used to add a sphere to the list
+ * build_scene - builds the bounding volume hierarchy once the spheres
+ *                  are added, must be called before rendering
+ * setup_scene - builds the light and spheres of the assignment scene
+ * random_scene - builds a reproducible scene of any number of spheres,
+ *                  for benchmarking
+ * random_lights - adds a reproducible set of point lights to a scene
+ */
+#include "scene.h"
+#include "gbuffer.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*empty scene with the default depth and floor*/
+void init_scene(scene * sc){
+    sc->list = NULL;
+    sc->sphere_count = sc->sphere_capacity = 0;
+    sc->view.x1 = -SCENE_WIDTH/2;
+    sc->view.y1 = -SCENE_HEIGHT/2;
+    sc->view.x2 = SCENE_WIDTH/2;
+    sc->view.y2 = SCENE_HEIGHT/2;
+    sc->max_ray_depth = 5;
+    sc->min_weight = DEFAULT_MIN_WEIGHT;
+    sc->roulette = false;
+    sc->floor = -SCENE_HEIGHT/2;
+    memset(&sc->light0, 0, sizeof(light));
+    sc->lights = NULL;
+    sc->light_count = sc->light_capacity = 0;
+    memset(&sc->grid, 0, sizeof(light_grid));
+    sc->use_light_grid = true;
+    memset(&sc->accel, 0, sizeof(bvh));
+    sc->use_bvh = true;
+    sc->shadows = true;
+    sc->occluder_cache = true;
+    init_animation(&sc->anim);
+    sc->mapping = NULL;
+    sc->mapping_size = 0;
+}
+
+/*builds the acceleration structures over the spheres and lights added
+ * so far and orders their keys*/
+void build_scene(scene * sc){
+    build_bvh(&sc->accel, sc->list, sc->sphere_count);
+    build_light_grid(&sc->grid, sc->lights, sc->light_count);
+    sort_keys(&sc->anim);
+}
+
+/*frees the spheres and the acceleration structure, leaving an empty scene*/
+void free_scene(scene * sc){
+    if(sc->mapping != NULL){
+        /*nothing was allocated, it all lives in the file*/
+        munmap(sc->mapping, sc->mapping_size);
+        sc->mapping = NULL;
+        memset(&sc->accel, 0, sizeof(bvh));
+        memset(&sc->grid, 0, sizeof(light_grid));
+    } else {
+        free(sc->list);
+        free(sc->lights);
+        free_bvh(&sc->accel);
+        free_light_grid(&sc->grid);
+    }
+    free_animation(&sc->anim);
+    sc->list = NULL;
+    sc->sphere_count = sc->sphere_capacity = 0;
+    sc->lights = NULL;
+    sc->light_count = sc->light_capacity = 0;
+}
+
+
+/*Phong Illumination at p with unit normal n and unit vector v back to the
+ * viewer, for the given material properties*/
+static color phong(point p, vector n, vector v, color ambient, color diffuse,
+                    color specular, double specular_exp, light lght){
+    vector l = normalize_vector(points_to_vector(p,lght.location));
+    vector h = scale_vector(0.5, add_vectors(l, v));
+
+    color ambient_r = multiply_colors(ambient, lght.ambient);
+
+    color diffuse_r = scale_color(dot_vector(l, n),
+                        multiply_colors(diffuse, lght.diffuse));
+    color specular_r = scale_color(pow(fabs(dot_vector(h,n)), specular_exp),
+                          multiply_colors(specular, lght.specular));
+
+    return add_colors3(ambient_r, diffuse_r, specular_r);
+}
+
+/*one channel of phong's sum: the ambient, diffuse and specular products
+ * of the material and light colors scaled by the diffuse cosine and the
+ * highlight, each clamped at 0 the way add_colors does*/
+static inline float phong_channel(float ambient, float diffuse, float specular,
+        double cosine, double highlight){
+    float a = ambient, d = cosine * diffuse, s = highlight * specular;
+    float sum = fmax(0, a) + fmax(0, d);
+    return fmax(0, sum) + fmax(0, s);
+}
+
+/*x raised to the whole power e by squaring*/
+static inline double whole_power(double x, int e){
+    double result = 1;
+    while(e > 0){
+        if(e & 1){
+            result *= x;
+        }
+        x *= x;
+        e >>= 1;
+    }
+    return result;
+}
+
+/*phong_hit's result for the red, green and blue channels of sl under
+ * lght given the light's direction l and the highlight*/
+static inline color phong_channels(const sphere_list * sl, light lght, vector l, vector n,
+        double highlight){
+    color c;
+    double cosine = dot_vector(l, n);
+    c.r = phong_channel(sl->ambient.r * lght.ambient.r, sl->diffuse.r * lght.diffuse.r,
+            sl->specular.r * lght.specular.r, cosine, highlight);
+    c.g = phong_channel(sl->ambient.g * lght.ambient.g, sl->diffuse.g * lght.diffuse.g,
+            sl->specular.g * lght.specular.g, cosine, highlight);
+    c.b = phong_channel(sl->ambient.b * lght.ambient.b, sl->diffuse.b * lght.diffuse.b,
+            sl->specular.b * lght.specular.b, cosine, highlight);
+    c.a = 1;
+    return c;
+}
+
+static color shade_phong(const sphere_list * sl, point p, vector n, vector v, light lght){
+    vector l = normalize_vector(points_to_vector(p, lght.location));
+    vector h = scale_vector(0.5, add_vectors(l, v));
+    return phong_channels(sl, lght, l, n, pow(fabs(dot_vector(h, n)), sl->s_exp));
+}
+
+static color shade_phong_whole(const sphere_list * sl, point p, vector n, vector v,
+        light lght){
+    vector l = normalize_vector(points_to_vector(p, lght.location));
+    vector h = scale_vector(0.5, add_vectors(l, v));
+    return phong_channels(sl, lght, l, n, whole_power(fabs(dot_vector(h, n)), (int)sl->s_exp));
+}
+
+static color shade_diffuse(const sphere_list * sl, point p, vector n, vector v, light lght){
+    vector l = normalize_vector(points_to_vector(p, lght.location));
+    (void)v;
+    return phong_channels(sl, lght, l, n, 0);
+}
+
+/*the shading routine of each kind of material, indexed by its shading*/
+static color (* const shaders[SHADE_COUNT])(const sphere_list * sl, point p, vector n,
+        vector v, light lght) = {
+    shade_phong, shade_phong_whole, shade_diffuse
+};
+
+/*picks the cheapest shading routine that colors sl as phong would. A
+ * specular color that is nowhere positive only ever adds a clamped 0*/
+static shading classify_material(const sphere_list * sl){
+    if(sl->specular.r <= 0 && sl->specular.g <= 0 && sl->specular.b <= 0){
+        return SHADE_DIFFUSE;
+    }
+    if(sl->s_exp >= 0 && sl->s_exp <= MAX_WHOLE_EXPONENT && sl->s_exp == floor(sl->s_exp)){
+        return SHADE_PHONG_WHOLE;
+    }
+    return SHADE_PHONG;
+}
+
+/*finds the Phong Illumination at the given point on the sphere at center sphere_center
+ * with the given material properties*/
+color phong_sphere(point sphere_center, point p, point viewer, color ambient, color diffuse,
+                    color specular, double specular_exp, light lght){
+    vector v = normalize_vector(points_to_vector(p, viewer));
+    vector n = normalize_vector(points_to_vector( sphere_center, p));
+
+    return phong(p, n, v, ambient, diffuse, specular, specular_exp, lght);
+}
+
+/*the Phong Illumination of sl at p given its unit normal n and the unit
+ * vector v back to the viewer, all of a hit that depends on the light*/
+color phong_hit(const sphere_list * sl, point p, vector n, vector v, light lght){
+    return shaders[sl->shade](sl, p, n, v, lght);
+}
+
+/*finds the closest sphere hit by r, false if none is hit*/
+bool closest_sphere(tracer * tr, ray r, hit_record * hit){
+    bool found;
+    STAT(++tr->stats.rays);
+    if(tr->sc->use_bvh){
+        found = bvh_closest(&tr->sc->accel, r, hit, &tr->stats);
+    } else {
+        found = linear_closest(&tr->sc->accel, r, hit, &tr->stats);
+    }
+    STAT(tr->stats.sphere_hits += found);
+    return found;
+}
+
+/*whether a light at location is blocked from p, on a surface with unit
+ * normal n: either the surface faces away from it or a sphere lies in
+ * between*/
+static bool in_shadow(tracer * tr, point p, vector n, point location){
+    const scene * sc = tr->sc;
+    ray r;
+    int blocker;
+
+    r.orgin = p;
+    r.at = location;
+    if(dot_vector(ray_to_vector(r), n) <= 0){
+        return true;
+    }
+    STAT(++tr->stats.shadow_rays);
+    if(sc->use_bvh){
+        blocker = bvh_any_hit(&sc->accel, r,
+                sc->occluder_cache ? tr->last_occluder : -1, &tr->stats);
+    } else {
+        blocker = linear_any_hit(&sc->accel, r, &tr->stats);
+    }
+    if(blocker >= 0){
+        STAT(tr->stats.occluder_hits += sc->occluder_cache && blocker == tr->last_occluder);
+        tr->last_occluder = blocker;
+        return true;
+    }
+    return false;
+}
+
+/*what the point lights in reach of p add to the color of sl there.
+ * Each fades as (1 - d^2/radius^2)^2 with its distance d, reaching
+ * nothing at its radius*/
+static color point_lights(tracer * tr, const sphere_list * sl, point p, vector n,
+        vector v){
+    const scene * sc = tr->sc;
+    color sum = {0, 0, 0, 1};
+    vector to;
+    double d2, r2, fade;
+    const int * in_reach = NULL;
+    int i, count = sc->light_count;
+
+    if(sc->use_light_grid){
+        in_reach = grid_lights(&sc->grid, p, &count);
+    }
+    for(i = 0; i < count; ++i){
+        const point_light * pl = &sc->lights[in_reach != NULL ? in_reach[i] : i];
+        color c;
+        STAT(++tr->stats.light_tests);
+        to = points_to_vector(p, pl->l.location);
+        d2 = dot_vector(to, to);
+        r2 = pl->radius * pl->radius;
+        if(d2 >= r2 || dot_vector(to, n) <= 0){
+            continue;
+        }
+        if(sc->shadows && in_shadow(tr, p, n, pl->l.location)){
+            continue;
+        }
+        STAT(++tr->stats.light_evals);
+        fade = (1 - d2 / r2) * (1 - d2 / r2);
+        c = phong_hit(sl, p, n, v, pl->l);
+        sum.r += fade * c.r;
+        sum.g += fade * c.g;
+        sum.b += fade * c.b;
+    }
+    return sum;
+}
+
+/*the color sl shows at p (unit normal n, unit vector v back to the
+ * viewer) under the scene's lights. Only its ambient part is left of
+ * light0 when the hit is in its shadow*/
+color light_hit(tracer * tr, const sphere_list * sl, point p, vector n, vector v){
+    const scene * sc = tr->sc;
+    color result;
+    STAT(++tr->stats.phong_evals);
+    if(sc->shadows && in_shadow(tr, p, n, sc->light0.location)){
+        STAT(++tr->stats.shadowed);
+        result = multiply_colors(sl->ambient, sc->light0.ambient);
+    } else {
+        result = phong_hit(sl, p, n, v, sc->light0);
+    }
+    if(sc->light_count > 0){
+        color more = point_lights(tr, sl, p, n, v);
+        result.r += more.r;
+        result.g += more.g;
+        result.b += more.b;
+    }
+    return result;
+}
+
+/*starts a thread's tracer on sc with its own random sequence*/
+void init_tracer(tracer * tr, const scene * sc, unsigned long long seed){
+    tr->sc = sc;
+    tr->rng = seed * 0x9e3779b97f4a7c15ull + 1;
+    tr->cache = NULL;
+    tr->first_hit = NULL;
+    tr->pixel = 0;
+    tr->first_pixel = 0;
+    tr->last_occluder = -1;
+    memset(&tr->stats, 0, sizeof(ray_stats));
+}
+
+/*uniform random number in [0, 1), xorshift64* */
+double tracer_random(tracer * tr){
+    tr->rng ^= tr->rng >> 12;
+    tr->rng ^= tr->rng << 25;
+    tr->rng ^= tr->rng >> 27;
+    return ((tr->rng * 0x2545f4914f6cdd1dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*uniform number in [0, 1) for the roulette of pixel's reflection at
+ * depth, a hash of them and the tracer's seed (splitmix64's finalizer),
+ * so it does not depend on the order the rays are traced in*/
+static double path_random(const tracer * tr, int pixel, int depth){
+    unsigned long long z = tr->rng + (tr->first_pixel + pixel) * 0x9e3779b97f4a7c15ull
+        + (unsigned long long)depth * 0xd1b54a32d192ed03ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*decides whether a reflection of pixel at depth (that of the reflected
+ * ray) whose path weight (the product of the reflectivities that scale
+ * its color into the pixel) is weight is worth casting. Returns 0 to drop
+ * it, otherwise the factor to scale its color by: 1, or 1/p for a ray
+ * kept by Russian roulette with probability p. Both engines draw the
+ * same roulette for the same reflection*/
+double continue_path(const tracer * tr, double weight, int pixel, int depth){
+    const scene * sc = tr->sc;
+    double p;
+    if(weight >= sc->min_weight){
+        return 1;
+    }
+    if(!sc->roulette || weight <= 0){
+        return 0;
+    }
+    p = weight / sc->min_weight;
+    return path_random(tr, pixel, depth) < p ? 1 / p : 0;
+}
+
+/*colors the closest hit of r, or the floor and background when hit is a
+ * miss; depth is the depth of the reflected ray and weight the path
+ * weight of r*/
+static color shade_hit(tracer * tr, ray r, const hit_record * hit, int depth,
+        double weight){
+    const scene * sc = tr->sc;
+    const sphere_list * closest = hit->index >= 0 ? hit_sphere(sc, hit) : NULL;
+    point p_saved;
+    vector normal, view;
+    color result = {BLACK}, reflect_color;
+    double keep;
+
+    if(depth == 1 && tr->first_hit != NULL){
+        tr->first_hit[tr->pixel] = closest;
+    }
+    if(closest == NULL){
+        //test for intersection with bottom
+        if(r.at.y - r.orgin.y < 0){
+            keep = continue_path(tr, weight, tr->pixel, depth);
+            if(keep > 0){
+                STAT(++tr->stats.floor_hits);
+                p_saved = find_y_plane_intersection(r, sc->floor);
+                normal.x = 0;
+                normal.y = 1;
+                normal.z = 0;
+                // use bottom as mirror
+                reflect_color = cast_ray(tr, reflect_ray(r, p_saved, normal), depth,
+                        weight * keep);
+                result = add_colors(result, scale_color(keep, reflect_color));
+            } else {
+                STAT(++tr->stats.weight_cut);
+            }
+        }
+        /*no intersections means the light has left the scene*/
+        return result;
+    }
+
+    //do Phong
+    p_saved = parametric_ray(r, hit->t);
+    normal = hit_normal(sc, hit, p_saved);
+    view = normalize_vector(points_to_vector(p_saved, r.orgin));
+    result = light_hit(tr, closest, p_saved, normal, view);
+    gbuffer_record(tr->cache, tr->pixel, closest, p_saved, normal, view, weight);
+
+    //cast reflection, unless it could not visibly change the pixel
+    if(closest->reflectivity <= 0){
+        return result;
+    }
+    weight *= closest->reflectivity;
+    keep = continue_path(tr, weight, tr->pixel, depth);
+    if(keep > 0){
+        reflect_color = cast_ray(tr, reflect_ray(r, p_saved, normal), depth,
+                weight * keep);
+        result.r += keep * closest->reflectivity * reflect_color.r;
+        result.g += keep * closest->reflectivity * reflect_color.g;
+        result.b += keep * closest->reflectivity * reflect_color.b;
+    } else {
+        STAT(++tr->stats.weight_cut);
+    }
+
+
+    //cast refraction here if desired
+
+
+    return result;
+}
+
+/*cast a ray into the scene, depth is used to stop the recursion and
+ * weight is the share of the pixel's color this ray's color makes up*/
+color cast_ray(tracer * tr, ray r, int depth, double weight){
+    color result = {BLACK};
+    hit_record hit;
+
+    if(depth >= tr->sc->max_ray_depth){
+        STAT(++tr->stats.depth_cap);
+        return result;
+    }
+    STAT(++tr->stats.rays_by_depth[stats_depth(depth)]);
+    ++depth;
+    //find intersection
+    closest_sphere(tr, r, &hit);
+
+    return shade_hit(tr, r, &hit, depth, weight);
+}
+
+/*casts n rays sharing one direction (the primary rays of a parallel
+ * camera) into the scene at depth 0, finding their closest hits together.
+ * Reflections diverge, so they are cast one at a time. pixels are the
+ * canvas indices of the rays, for tr->cache*/
+void cast_packet(tracer * tr, const ray * rays, const int * pixels, int n, color * out){
+    const scene * sc = tr->sc;
+    hit_record hits[MAX_PACKET];
+    vector d = ray_to_vector(rays[0]), di;
+    bool coherent = sc->use_bvh && n <= MAX_PACKET;
+    int i;
+
+    for(i = 1; coherent && i < n; ++i){
+        di = ray_to_vector(rays[i]);
+        coherent = di.x == d.x && di.y == d.y && di.z == d.z;
+    }
+    if(!coherent || sc->max_ray_depth == 0){
+        for(i = 0; i < n; ++i){
+            tr->pixel = pixels[i];
+            out[i] = cast_ray(tr, rays[i], 0, 1.0);
+        }
+        return;
+    }
+
+    STAT(tr->stats.rays += n);
+    STAT(tr->stats.rays_by_depth[0] += n);
+    bvh_closest_packet(&sc->accel, rays, n, hits, &tr->stats);
+    for(i = 0; i < n; ++i){
+        STAT(tr->stats.sphere_hits += hits[i].index >= 0);
+        tr->pixel = pixels[i];
+        out[i] = shade_hit(tr, rays[i], &hits[i], 1, 1.0);
+    }
+}
+
+/* Add a sphere to the end of the list */
+void add_sphere(scene * sc, double x, double y, double z, double r, color c,
+        double reflectivity, double spec_exp){
+    sphere_list newNode;
+    newNode.s.center.x = x;
+    newNode.s.center.y = y;
+    newNode.s.center.z = z;
+    newNode.s.radius = r;
+    newNode.ambient = c;
+    newNode.diffuse = c;
+    newNode.specular = c;
+    newNode.s_exp = spec_exp;
+    newNode.reflectivity = reflectivity;
+    append_sphere(sc, &newNode);
+
+}
+
+/*copies sl to the end of the list, growing the array by doubling*/
+void append_sphere(scene * sc, const sphere_list * sl){
+    if(sc->sphere_count == sc->sphere_capacity){
+        sc->sphere_capacity = sc->sphere_capacity > 0 ? 2 * sc->sphere_capacity : 16;
+        sc->list = realloc(sc->list, sizeof(sphere_list) * sc->sphere_capacity);
+    }
+    sc->list[sc->sphere_count] = *sl;
+    sc->list[sc->sphere_count++].shade = classify_material(sl);
+}
+
+/*adds a copy of pl to the end of the scene's point lights*/
+void add_light(scene * sc, const point_light * pl){
+    if(sc->light_count == sc->light_capacity){
+        sc->light_capacity = sc->light_capacity > 0 ? 2 * sc->light_capacity : 16;
+        sc->lights = realloc(sc->lights, sizeof(point_light) * sc->light_capacity);
+    }
+    sc->lights[sc->light_count] = *pl;
+    /*only light0 lights the whole scene*/
+    memset(&sc->lights[sc->light_count++].l.ambient, 0, sizeof(color));
+}
+
+/*creates the light and the spheres of the scene*/
+void setup_scene(scene * sc){
+    /*setup some colors*/
+    color green = {GREEN};
+    color silver = {.4,.4,.4, 1.0};
+    color white = {.95,.95,.95, 1.0};
+    color orange = {ORANGE};
+    color red = {RED};
+    color yellow = {YELLOW};
+    color blue = {BLUE};
+
+    init_scene(sc);
+
+    /*create the light*/
+    sc->light0.location.x = 0;
+    sc->light0.location.y = 0;
+    sc->light0.location.z = 10;
+
+    sc->light0.ambient.r = .12;
+    sc->light0.ambient.g = .12;
+    sc->light0.ambient.b = .12;
+
+    sc->light0.diffuse.r = .32;
+    sc->light0.diffuse.g = .32;
+    sc->light0.diffuse.b = .32;
+
+    sc->light0.specular.r = .4;
+    sc->light0.specular.g = .4;
+    sc->light0.specular.b = .4;
+
+    add_sphere(sc, 0,0,-20,6, silver, 0.7, 9);
+    add_sphere(sc, 15,15,-20,7, white, 0.5, 1.4);
+    add_sphere(sc, 78,52,-70,10, green, 0.5, 1.2);
+    add_sphere(sc, 48,51,-68,10, red, 0.5, 1.1);
+    add_sphere(sc, 50,50,-40,4, yellow, 0.5, 1.2);
+
+    add_sphere(sc, -9,11,-11,10, orange, 0.5, 1.2);
+
+    add_sphere(sc, 3,11,-11,2, red, 0.5, 1.2);
+    add_sphere(sc, -50,0,-50,25, yellow, 0.5, 1.2);
+    add_sphere(sc, 45,5,20,18, blue, 0.5, 1.2);
+
+    build_scene(sc);
+}
+
+/*creates the light of setup_scene and count spheres of random size,
+ * color and finish spread through the view volume. The same count and
+ * seed always give the same scene; the spheres shrink as count grows so
+ * they cover about the same share of the image*/
+void random_scene(scene * sc, int count, unsigned long long seed){
+    color palette[] = {{GREEN}, {ORANGE}, {RED}, {YELLOW}, {BLUE},
+                       {.4,.4,.4, 1.0}, {.95,.95,.95, 1.0}};
+    int palette_size = sizeof(palette) / sizeof(palette[0]);
+    double radius = fmin(20, sqrt(2.0 * SCENE_WIDTH * SCENE_HEIGHT / (M_PI * count)));
+    tracer rng;
+    int i;
+
+    init_scene(sc);
+    init_tracer(&rng, sc, seed);
+
+    sc->light0.location.z = 10;
+    sc->light0.ambient.r = sc->light0.ambient.g = sc->light0.ambient.b = .12;
+    sc->light0.diffuse.r = sc->light0.diffuse.g = sc->light0.diffuse.b = .32;
+    sc->light0.specular.r = sc->light0.specular.g = sc->light0.specular.b = .4;
+
+    for(i = 0; i < count; ++i){
+        double x = (tracer_random(&rng) - 0.5) * SCENE_WIDTH;
+        double y = (tracer_random(&rng) - 0.5) * SCENE_HEIGHT;
+        double z = -10 - tracer_random(&rng) * 140;
+        double r = radius * (0.5 + tracer_random(&rng));
+        color c = palette[(int)(tracer_random(&rng) * palette_size)];
+        double reflectivity = 0.3 + 0.4 * tracer_random(&rng);
+        double spec_exp = 1 + 9 * tracer_random(&rng);
+        add_sphere(sc, x, y, z, r, c, reflectivity, spec_exp);
+    }
+
+    build_scene(sc);
+}
+
+/*adds count point lights of random color spread through the volume of
+ * random_scene and rebuilds the light grid. Their reach shrinks as count
+ * grows so about the same number of them reach any point*/
+void random_lights(scene * sc, int count, unsigned long long seed){
+    double depth = 150, volume = SCENE_WIDTH * SCENE_HEIGHT * depth;
+    /*about 8 lights reach a point, each a little dimmer than light0*/
+    double radius = cbrt(8 * volume / (4.0 / 3 * M_PI * count));
+    point_light pl;
+    tracer rng;
+    int i;
+
+    init_tracer(&rng, sc, seed);
+    for(i = 0; i < count; ++i){
+        pl.l.location.x = (tracer_random(&rng) - 0.5) * SCENE_WIDTH;
+        pl.l.location.y = (tracer_random(&rng) - 0.5) * SCENE_HEIGHT;
+        pl.l.location.z = 10 - tracer_random(&rng) * depth;
+        pl.l.diffuse.r = 0.1 + 0.2 * tracer_random(&rng);
+        pl.l.diffuse.g = 0.1 + 0.2 * tracer_random(&rng);
+        pl.l.diffuse.b = 0.1 + 0.2 * tracer_random(&rng);
+        pl.l.diffuse.a = 1.0;
+        pl.l.specular = pl.l.diffuse;
+        pl.radius = radius * (0.75 + 0.5 * tracer_random(&rng));
+        add_light(sc, &pl);
+    }
+    build_light_grid(&sc->grid, sc->lights, sc->light_count);
+}
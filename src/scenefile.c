@@ -0,0 +1,628 @@
+/*********************
+ * Loading and saving scenes, see scenefile.h for the formats.
+ *
+ * load_scene - reads either format, telling them apart by the header
+ * save_scene_text - writes the text format
+ * save_scene_binary - writes the mappable binary format
+ */
+#include "scenefile.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SCENE_MAGIC "RAYFOOSC"
+#define SCENE_VERSION 3
+/*written as is, reads back differently on a machine of the other byte order*/
+#define SCENE_BYTE_ORDER 0x01020304u
+#define SCENE_ALIGN 64
+
+#define MAX_LINE 1024
+/*most frames a text scene may ask for*/
+#define MAX_FRAMES 1000000
+#define MAX_TOKENS 24
+#define MAX_NAME 32
+
+/*the start of a binary scene file, offsets are from the start of the file*/
+typedef struct scene_header_struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    /*sizes of the records, so a file from another struct layout or the
+     * other precision build is refused*/
+    uint32_t header_size, real_size, sphere_size, node_size, light_size;
+    uint32_t sphere_count, node_count;
+    uint32_t soa_count;     /*length of each intersection array*/
+    uint32_t light_count;
+    camera view;
+    double floor;
+    light light0;
+    /*the light grid but for its arrays*/
+    point grid_min;
+    vector grid_inv_cell;
+    uint32_t grid_nx, grid_ny, grid_nz, grid_entries;
+    uint64_t spheres, nodes, cx, cy, cz, r2, material;
+    uint64_t lights, grid_first, grid_lights;
+    uint64_t file_size;
+} scene_header;
+
+/*a named material of a text scene*/
+typedef struct named_material_struct {
+    char name[MAX_NAME];
+    sphere_list m;
+} named_material;
+
+/*reads count numbers from tokens into out*/
+static bool parse_numbers(char ** tokens, int count, double * out){
+    char * end;
+    int i;
+    for(i = 0; i < count; ++i){
+        out[i] = strtod(tokens[i], &end);
+        if(end == tokens[i] || *end != '\0'){
+            return false;
+        }
+    }
+    return true;
+}
+
+static color make_color(const double * v){
+    color c;
+    c.r = v[0];
+    c.g = v[1];
+    c.b = v[2];
+    c.a = 1.0;
+    return c;
+}
+
+/*parses one tokenized line into sc, returns an error message or NULL*/
+static const char * parse_line(scene * sc, char ** tok, int n,
+        named_material ** materials, int * material_count){
+    double v[14];
+    int i;
+
+    if(strcmp(tok[0], "camera") == 0){
+        if(n != 5 || !parse_numbers(tok + 1, 4, v)){
+            return "camera takes X1 Y1 X2 Y2";
+        }
+        if(v[2] <= v[0] || v[3] <= v[1]){
+            return "camera needs X2 > X1 and Y2 > Y1";
+        }
+        sc->view.x1 = v[0];
+        sc->view.y1 = v[1];
+        sc->view.x2 = v[2];
+        sc->view.y2 = v[3];
+    } else if(strcmp(tok[0], "floor") == 0){
+        if(n != 2 || !parse_numbers(tok + 1, 1, v)){
+            return "floor takes Y";
+        }
+        sc->floor = v[0];
+    } else if(strcmp(tok[0], "light") == 0){
+        if(n != 13 || !parse_numbers(tok + 1, 12, v)){
+            return "light takes X Y Z and ambient, diffuse and specular R G B";
+        }
+        sc->light0.location.x = v[0];
+        sc->light0.location.y = v[1];
+        sc->light0.location.z = v[2];
+        sc->light0.ambient = make_color(v + 3);
+        sc->light0.diffuse = make_color(v + 6);
+        sc->light0.specular = make_color(v + 9);
+    } else if(strcmp(tok[0], "point_light") == 0){
+        point_light pl;
+        if(n != 11 || !parse_numbers(tok + 1, 10, v)){
+            return "point_light takes X Y Z, diffuse and specular R G B and RADIUS";
+        }
+        if(v[9] <= 0){
+            return "point_light radius must be positive";
+        }
+        pl.l.location.x = v[0];
+        pl.l.location.y = v[1];
+        pl.l.location.z = v[2];
+        pl.l.diffuse = make_color(v + 3);
+        pl.l.specular = make_color(v + 6);
+        pl.radius = v[9];
+        add_light(sc, &pl);
+    } else if(strcmp(tok[0], "material") == 0){
+        named_material * nm;
+        if(n != 13 || strlen(tok[1]) >= MAX_NAME || !parse_numbers(tok + 2, 11, v)){
+            return "material takes NAME, ambient, diffuse and specular R G B, "
+                   "REFLECTIVITY and EXPONENT";
+        }
+        *materials = realloc(*materials, sizeof(named_material) * (*material_count + 1));
+        nm = &(*materials)[(*material_count)++];
+        strcpy(nm->name, tok[1]);
+        nm->m.ambient = make_color(v);
+        nm->m.diffuse = make_color(v + 3);
+        nm->m.specular = make_color(v + 6);
+        nm->m.reflectivity = v[9];
+        nm->m.s_exp = v[10];
+    } else if(strcmp(tok[0], "sphere") == 0){
+        sphere_list sl;
+        if(n == 6 && parse_numbers(tok + 1, 4, v)){
+            /*the latest material of that name*/
+            for(i = *material_count - 1; i >= 0; --i){
+                if(strcmp((*materials)[i].name, tok[5]) == 0){
+                    break;
+                }
+            }
+            if(i < 0){
+                return "unknown material";
+            }
+            sl = (*materials)[i].m;
+        } else if(n == 10 && parse_numbers(tok + 1, 9, v)){
+            sl.ambient = sl.diffuse = sl.specular = make_color(v + 4);
+            sl.reflectivity = v[7];
+            sl.s_exp = v[8];
+        } else {
+            return "sphere takes X Y Z RADIUS and a material name or R G B "
+                   "REFLECTIVITY EXPONENT";
+        }
+        if(v[3] <= 0){
+            return "sphere radius must be positive";
+        }
+        sl.s.center.x = v[0];
+        sl.s.center.y = v[1];
+        sl.s.center.z = v[2];
+        sl.s.radius = v[3];
+        append_sphere(sc, &sl);
+    } else if(strcmp(tok[0], "frames") == 0){
+        if(n != 2 || !parse_numbers(tok + 1, 1, v) || v[0] != floor(v[0])
+                || v[0] < 1 || v[0] > MAX_FRAMES){
+            return "frames takes a count of frames";
+        }
+        if(sc->anim.sphere_key_count > 0 || sc->anim.light_key_count > 0){
+            return "frames must come before the keys";
+        }
+        sc->anim.frame_count = (int)v[0];
+    } else if(strcmp(tok[0], "key") == 0){
+        int frame;
+        if(n < 3 || !parse_numbers(tok + 1, 1, v) || v[0] != floor(v[0])){
+            return "key takes FRAME and a sphere or the light";
+        }
+        if(sc->anim.frame_count == 0){
+            return "frames must come before the keys";
+        }
+        if(v[0] < 0 || v[0] >= sc->anim.frame_count){
+            return "key frame is not one of the frames";
+        }
+        frame = (int)v[0];
+        if(strcmp(tok[2], "sphere") == 0){
+            sphere s;
+            if(n != 8 || !parse_numbers(tok + 3, 5, v) || v[0] != floor(v[0])){
+                return "key FRAME sphere takes INDEX X Y Z RADIUS";
+            }
+            if(v[0] < 0 || v[0] >= sc->sphere_count){
+                return "key sphere index is not one of the spheres above it";
+            }
+            if(v[4] <= 0){
+                return "sphere radius must be positive";
+            }
+            s.center.x = v[1];
+            s.center.y = v[2];
+            s.center.z = v[3];
+            s.radius = v[4];
+            add_sphere_key(&sc->anim, frame, (int)v[0], s);
+        } else if(strcmp(tok[2], "light") == 0){
+            point location;
+            if(n != 6 || !parse_numbers(tok + 3, 3, v)){
+                return "key FRAME light takes X Y Z";
+            }
+            location.x = v[0];
+            location.y = v[1];
+            location.z = v[2];
+            add_light_key(&sc->anim, frame, location);
+        } else {
+            return "key takes FRAME and a sphere or the light";
+        }
+    } else {
+        return "unknown item";
+    }
+    return NULL;
+}
+
+/*reads the text scene in f and builds it*/
+static bool load_text(scene * sc, FILE * f, const char * path){
+    char line[MAX_LINE], * tok[MAX_TOKENS], * comment;
+    named_material * materials = NULL;
+    int material_count = 0, line_number = 0, n;
+    const char * error = NULL;
+
+    init_scene(sc);
+    while(error == NULL && fgets(line, sizeof(line), f) != NULL){
+        ++line_number;
+        if((comment = strchr(line, '#')) != NULL){
+            *comment = '\0';
+        }
+        n = 0;
+        for(tok[n] = strtok(line, " \t\r\n"); tok[n] != NULL && n < MAX_TOKENS - 1;
+                tok[n] = strtok(NULL, " \t\r\n")){
+            ++n;
+        }
+        if(n > 0){
+            error = parse_line(sc, tok, n, &materials, &material_count);
+        }
+    }
+    free(materials);
+    if(error != NULL){
+        fprintf(stderr, "%s:%d: %s\n", path, line_number, error);
+        free_scene(sc);
+        return false;
+    }
+    build_scene(sc);
+    return true;
+}
+
+/*whether [offset, offset + size) is a properly aligned part of the file*/
+static bool in_file(const scene_header * h, uint64_t offset, uint64_t size){
+    return offset % SCENE_ALIGN == 0 && offset <= h->file_size
+        && size <= h->file_size - offset;
+}
+
+/*whether the indices of a mapped scene stay inside it: its tree, each
+ * sphere's shading routine and the light grid's cells and lights. The
+ * grid's corner and cell density must be finite too, or a lookup's cell
+ * is not*/
+static bool check_indices(const scene * sc){
+    int i, cells;
+    if(!check_bvh(&sc->accel)){
+        return false;
+    }
+    for(i = 0; i < sc->sphere_count; ++i){
+        if(sc->list[i].shade < 0 || sc->list[i].shade >= SHADE_COUNT){
+            return false;
+        }
+    }
+    if(sc->light_count == 0){
+        return true;
+    }
+    if(!isfinite(sc->grid.min.x) || !isfinite(sc->grid.min.y) || !isfinite(sc->grid.min.z)
+            || !(sc->grid.inv_cell.x > 0 && isfinite(sc->grid.inv_cell.x))
+            || !(sc->grid.inv_cell.y > 0 && isfinite(sc->grid.inv_cell.y))
+            || !(sc->grid.inv_cell.z > 0 && isfinite(sc->grid.inv_cell.z))
+            || sc->grid.nx < 1 || sc->grid.nx > GRID_MAX_DIM
+            || sc->grid.ny < 1 || sc->grid.ny > GRID_MAX_DIM
+            || sc->grid.nz < 1 || sc->grid.nz > GRID_MAX_DIM){
+        return false;
+    }
+    cells = sc->grid.nx * sc->grid.ny * sc->grid.nz;
+    for(i = 0; i < cells; ++i){
+        if(sc->grid.first[i] < 0 || sc->grid.first[i] > sc->grid.first[i + 1]){
+            return false;
+        }
+    }
+    for(i = 0; i < sc->grid.entries; ++i){
+        if(sc->grid.lights[i] < 0 || sc->grid.lights[i] >= sc->light_count){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*maps the binary scene in the file fd of size bytes and points sc at it*/
+static bool load_binary(scene * sc, int fd, size_t size, const char * path){
+    const scene_header * h;
+    unsigned char * base;
+    uint64_t n, cells;
+
+    if(size < sizeof(scene_header)){
+        fprintf(stderr, "%s: truncated scene file\n", path);
+        return false;
+    }
+    base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED){
+        perror(path);
+        return false;
+    }
+    h = (const scene_header *)base;
+    n = h->soa_count;
+    cells = h->light_count > 0 ? (uint64_t)h->grid_nx * h->grid_ny * h->grid_nz + 1 : 0;
+    if(h->version != SCENE_VERSION || h->byte_order != SCENE_BYTE_ORDER
+            || h->header_size != sizeof(scene_header) || h->real_size != sizeof(real)
+            || h->sphere_size != sizeof(sphere_list) || h->node_size != sizeof(bvh_node)
+            || h->light_size != sizeof(point_light)
+            || h->file_size != size || n != h->sphere_count + SOA_PADDING
+            || (h->sphere_count > 0) != (h->node_count > 0)
+            || !in_file(h, h->spheres, (uint64_t)h->sphere_count * sizeof(sphere_list))
+            || !in_file(h, h->nodes, (uint64_t)h->node_count * sizeof(bvh_node))
+            || !in_file(h, h->cx, n * sizeof(real)) || !in_file(h, h->cy, n * sizeof(real))
+            || !in_file(h, h->cz, n * sizeof(real)) || !in_file(h, h->r2, n * sizeof(real))
+            || !in_file(h, h->material, n * sizeof(int))
+            || !in_file(h, h->lights, (uint64_t)h->light_count * sizeof(point_light))
+            || !in_file(h, h->grid_first, cells * sizeof(int))
+            || !in_file(h, h->grid_lights, (uint64_t)h->grid_entries * sizeof(int))
+            || (cells > 0 && ((const int *)(base + h->grid_first))[cells - 1]
+                != (int)h->grid_entries)){
+        fprintf(stderr, "%s: not a scene file of version %d for this machine and build\n",
+                path, SCENE_VERSION);
+        munmap(base, size);
+        return false;
+    }
+
+    init_scene(sc);
+    sc->view = h->view;
+    sc->floor = h->floor;
+    sc->light0 = h->light0;
+    sc->list = (sphere_list *)(base + h->spheres);
+    sc->sphere_count = sc->sphere_capacity = h->sphere_count;
+
+    /*the tree is only ever read, so it can point into the read only map*/
+    sc->accel.nodes = (bvh_node *)(base + h->nodes);
+    sc->accel.node_count = h->node_count;
+    sc->accel.prims = sc->list;
+    sc->accel.prim_count = h->sphere_count;
+    sc->accel.soa.cx = (real *)(base + h->cx);
+    sc->accel.soa.cy = (real *)(base + h->cy);
+    sc->accel.soa.cz = (real *)(base + h->cz);
+    sc->accel.soa.r2 = (real *)(base + h->r2);
+    sc->accel.soa.material = (int *)(base + h->material);
+    sc->accel.soa.count = h->sphere_count;
+
+    sc->lights = (point_light *)(base + h->lights);
+    sc->light_count = sc->light_capacity = h->light_count;
+    if(h->light_count > 0){
+        sc->grid.min = h->grid_min;
+        sc->grid.inv_cell = h->grid_inv_cell;
+        sc->grid.nx = h->grid_nx;
+        sc->grid.ny = h->grid_ny;
+        sc->grid.nz = h->grid_nz;
+        sc->grid.first = (int *)(base + h->grid_first);
+        sc->grid.lights = (int *)(base + h->grid_lights);
+        sc->grid.entries = h->grid_entries;
+    }
+
+    sc->mapping = base;
+    sc->mapping_size = size;
+    /*the header only vouches for the sizes, the indices inside the
+     * sections are used as they are, so a corrupt file must not get past
+     * here*/
+    if(!check_indices(sc)){
+        fprintf(stderr, "%s: corrupt scene file\n", path);
+        free_scene(sc);
+        return false;
+    }
+    return true;
+}
+
+/*loads the scene in path, in either format, into sc ready to render.
+ * Prints what is wrong and returns false if it cannot*/
+bool load_scene(scene * sc, const char * path){
+    char magic[sizeof(((scene_header *)0)->magic)];
+    struct stat st;
+    bool ok;
+    FILE * f = fopen(path, "rb");
+
+    if(f == NULL || fstat(fileno(f), &st) != 0){
+        perror(path);
+        if(f != NULL){
+            fclose(f);
+        }
+        return false;
+    }
+    if(fread(magic, 1, sizeof(magic), f) == sizeof(magic)
+            && memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0){
+        ok = load_binary(sc, fileno(f), st.st_size, path);
+    } else {
+        rewind(f);
+        ok = load_text(sc, f, path);
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool same_color(color a, color b){
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+/*writes a space and v in the fewest digits that read back exactly*/
+static void put_double(FILE * f, double v){
+    char text[32];
+    int digits = 6;
+    do {
+        snprintf(text, sizeof(text), "%.*g", digits++, v);
+    } while(digits <= 17 && strtod(text, NULL) != v);
+    fprintf(f, " %s", text);
+}
+
+/*the same for the single precision parts of colors*/
+static void put_float(FILE * f, float v){
+    char text[32];
+    int digits = 6;
+    do {
+        snprintf(text, sizeof(text), "%.*g", digits++, v);
+    } while(digits <= 9 && strtof(text, NULL) != v);
+    fprintf(f, " %s", text);
+}
+
+static void put_color(FILE * f, color c){
+    fputc(' ', f);
+    put_float(f, c.r);
+    put_float(f, c.g);
+    put_float(f, c.b);
+}
+
+static void put_point(FILE * f, point p){
+    put_double(f, p.x);
+    put_double(f, p.y);
+    put_double(f, p.z);
+}
+
+/*writes sc as a text scene, numbers are printed so they read back exactly*/
+bool save_scene_text(const scene * sc, const char * path){
+    FILE * f = fopen(path, "w");
+    int i, materials = 0;
+
+    if(f == NULL){
+        return false;
+    }
+    fprintf(f, "# written by rayfoo\ncamera");
+    put_double(f, sc->view.x1);
+    put_double(f, sc->view.y1);
+    put_double(f, sc->view.x2);
+    put_double(f, sc->view.y2);
+    fprintf(f, "\nfloor");
+    put_double(f, sc->floor);
+    fprintf(f, "\nlight");
+    put_point(f, sc->light0.location);
+    put_color(f, sc->light0.ambient);
+    put_color(f, sc->light0.diffuse);
+    put_color(f, sc->light0.specular);
+    fputc('\n', f);
+    for(i = 0; i < sc->light_count; ++i){
+        const point_light * pl = &sc->lights[i];
+        fprintf(f, "point_light");
+        put_point(f, pl->l.location);
+        put_color(f, pl->l.diffuse);
+        put_color(f, pl->l.specular);
+        fputc(' ', f);
+        put_double(f, pl->radius);
+        fputc('\n', f);
+    }
+
+    for(i = 0; i < sc->sphere_count; ++i){
+        const sphere_list * sl = &sc->list[i];
+        bool one_color = same_color(sl->ambient, sl->diffuse)
+            && same_color(sl->ambient, sl->specular);
+        if(!one_color){
+            /*colors the short form cannot hold get a material of their own*/
+            fprintf(f, "material m%d", materials);
+            put_color(f, sl->ambient);
+            put_color(f, sl->diffuse);
+            put_color(f, sl->specular);
+            fputc(' ', f);
+            put_double(f, sl->reflectivity);
+            put_double(f, sl->s_exp);
+            fputc('\n', f);
+        }
+        fprintf(f, "sphere");
+        put_point(f, sl->s.center);
+        put_double(f, sl->s.radius);
+        if(one_color){
+            put_color(f, sl->ambient);
+            fputc(' ', f);
+            put_double(f, sl->reflectivity);
+            put_double(f, sl->s_exp);
+            fputc('\n', f);
+        } else {
+            fprintf(f, " m%d\n", materials++);
+        }
+    }
+
+    if(sc->anim.frame_count > 0){
+        fprintf(f, "frames %d\n", sc->anim.frame_count);
+    }
+    for(i = 0; i < sc->anim.sphere_key_count; ++i){
+        const sphere_key * k = &sc->anim.sphere_keys[i];
+        fprintf(f, "key %d sphere %d", k->frame, k->sphere);
+        put_point(f, k->s.center);
+        put_double(f, k->s.radius);
+        fputc('\n', f);
+    }
+    for(i = 0; i < sc->anim.light_key_count; ++i){
+        fprintf(f, "key %d light", sc->anim.light_keys[i].frame);
+        put_point(f, sc->anim.light_keys[i].location);
+        fputc('\n', f);
+    }
+    return fclose(f) == 0;
+}
+
+/*writes size bytes of data at the next multiple of SCENE_ALIGN after
+ * *offset, returning where it went*/
+static uint64_t write_aligned(FILE * f, const void * data, size_t size, uint64_t * offset,
+        bool * ok){
+    static const unsigned char zeros[SCENE_ALIGN];
+    uint64_t start = (*offset + SCENE_ALIGN - 1) / SCENE_ALIGN * SCENE_ALIGN;
+    if(fwrite(zeros, 1, start - *offset, f) != start - *offset
+            || fwrite(data, 1, size, f) != size){
+        *ok = false;
+    }
+    *offset = start + size;
+    return start;
+}
+
+/*writes sc, which must have been built, as a binary scene*/
+bool save_scene_binary(const scene * sc, const char * path){
+    static const real no_reals[SOA_PADDING];
+    static const int no_ints[SOA_PADDING];
+    const bvh * tree = &sc->accel;
+    const light_grid * grid = &sc->grid;
+    size_t n = tree->prim_count + SOA_PADDING;
+    scene_header h;
+    uint64_t offset = sizeof(scene_header);
+    bool ok = true;
+    FILE * f;
+
+    if(tree->prim_count != sc->sphere_count || (grid->first != NULL) != (sc->light_count > 0)){
+        fprintf(stderr, "%s: the scene has not been built\n", path);
+        return false;
+    }
+    if(sc->anim.frame_count > 0){
+        fprintf(stderr, "%s: binary scenes cannot hold keyframes, use the text format\n",
+                path);
+        return false;
+    }
+    if((f = fopen(path, "wb")) == NULL){
+        return false;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SCENE_MAGIC, sizeof(h.magic));
+    h.version = SCENE_VERSION;
+    h.byte_order = SCENE_BYTE_ORDER;
+    h.header_size = sizeof(scene_header);
+    h.real_size = sizeof(real);
+    h.sphere_size = sizeof(sphere_list);
+    h.node_size = sizeof(bvh_node);
+    h.light_size = sizeof(point_light);
+    h.sphere_count = tree->prim_count;
+    h.node_count = tree->node_count;
+    h.soa_count = n;
+    h.light_count = sc->light_count;
+    h.view = sc->view;
+    h.floor = sc->floor;
+    h.light0 = sc->light0;
+    h.grid_min = grid->min;
+    h.grid_inv_cell = grid->inv_cell;
+    h.grid_nx = grid->nx;
+    h.grid_ny = grid->ny;
+    h.grid_nz = grid->nz;
+    h.grid_entries = grid->entries;
+
+    /*the header goes last, once the offsets are known*/
+    fseek(f, sizeof(scene_header), SEEK_SET);
+    h.spheres = write_aligned(f, tree->prims, sizeof(sphere_list) * tree->prim_count,
+            &offset, &ok);
+    h.nodes = write_aligned(f, tree->nodes, sizeof(bvh_node) * tree->node_count, &offset, &ok);
+    if(tree->prim_count == 0){
+        /*an empty scene has no arrays, store just their padding*/
+        h.cx = h.cy = h.cz = h.r2 = write_aligned(f, no_reals, sizeof(no_reals),
+                &offset, &ok);
+        h.material = write_aligned(f, no_ints, sizeof(no_ints), &offset, &ok);
+    } else {
+        h.cx = write_aligned(f, tree->soa.cx, sizeof(real) * n, &offset, &ok);
+        h.cy = write_aligned(f, tree->soa.cy, sizeof(real) * n, &offset, &ok);
+        h.cz = write_aligned(f, tree->soa.cz, sizeof(real) * n, &offset, &ok);
+        h.r2 = write_aligned(f, tree->soa.r2, sizeof(real) * n, &offset, &ok);
+        h.material = write_aligned(f, tree->soa.material, sizeof(int) * n, &offset, &ok);
+    }
+    h.lights = write_aligned(f, sc->lights, sizeof(point_light) * sc->light_count,
+            &offset, &ok);
+    if(sc->light_count == 0){
+        h.grid_first = h.grid_lights = write_aligned(f, NULL, 0, &offset, &ok);
+    } else {
+        h.grid_first = write_aligned(f, grid->first,
+                sizeof(int) * (grid->nx * grid->ny * grid->nz + 1), &offset, &ok);
+        h.grid_lights = write_aligned(f, grid->lights, sizeof(int) * grid->entries,
+                &offset, &ok);
+    }
+    h.file_size = offset;
+
+    if(fseek(f, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, f) != 1){
+        ok = false;
+    }
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,534 @@
+/*********************
+ * The render server: one renderer, its pool and the loaded scenes kept
+ * for as long as it runs, requests taken from any number of connections.
+ *
+ * run_server - listens and serves requests until told to shut down
+ * read_client - takes what a connection sent and queues its whole lines
+ * serve_request - answers the request at the head of the queue
+ * render_request - poses, frames and traces a scene, writing the image
+ *
+ * Rendering blocks the loop, so a connection's requests are read while
+ * the one before is traced only as far as the socket buffers them; they
+ * are queued once the render is done and served in arrival order.
+ */
+#include "server.h"
+#include "net.h"
+#include "render.h"
+#include "scene.h"
+#include "scenefile.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 64
+#define MAX_REQUEST 4096        /*longest request line*/
+#define MAX_ARGUMENTS 32
+#define MAX_SCENE_NAME 64
+/*seconds a client may leave its replies unread before it is dropped*/
+#define REPLY_TIMEOUT 5
+
+/*a loaded scene and what each render starts from*/
+typedef struct served_scene_struct {
+    char name[MAX_SCENE_NAME];
+    scene sc;
+    camera view;            /*as loaded, configure_scene changes sc.view*/
+    point light;            /*light0's location as loaded*/
+} served_scene;
+
+/*a connection and the part of a request line it has sent so far*/
+typedef struct client_struct {
+    int fd;
+    int id;
+    bool hung_up;           /*has sent all it will, replies may still go*/
+    char line[MAX_REQUEST];
+    int length;
+} client;
+
+typedef struct request_struct {
+    int client;             /*id of the connection it came on*/
+    char * line;
+} request;
+
+typedef struct server_struct {
+    const render_options * opts;
+    renderer rd;
+    served_scene ** scenes;
+    int scene_count;
+    client clients[MAX_CLIENTS];
+    int client_count, next_id;
+    request * queue;        /*oldest first*/
+    int queued, queue_capacity;
+    unsigned long requests, renders;
+    double render_seconds;
+    bool running;
+} server;
+
+static double seconds_since(struct timespec start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*sends c one reply line; a client that cannot take it is closed*/
+static void reply(client * c, const char * format, ...){
+    char line[MAX_REQUEST];
+    va_list args;
+    int n;
+    va_start(args, format);
+    n = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if(n < 0 || n > (int)sizeof(line) - 2){
+        n = sizeof(line) - 2;
+    }
+    line[n++] = '\n';
+    if(c->fd >= 0 && !write_all(c->fd, line, n)){
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+static served_scene * find_scene(server * sv, const char * name, int * index){
+    int i;
+    for(i = 0; i < sv->scene_count; ++i){
+        if(strcmp(sv->scenes[i]->name, name) == 0){
+            if(index != NULL){
+                *index = i;
+            }
+            return sv->scenes[i];
+        }
+    }
+    return NULL;
+}
+
+static void free_served(served_scene * s){
+    free_scene(&s->sc);
+    free(s);
+}
+
+/*load NAME FILE|builtin: loads and builds a scene, replacing any of the
+ * same name once the new one is ready*/
+static void load_request(server * sv, client * c, int argc, char ** argv){
+    struct timespec start;
+    served_scene * s, * old;
+    int i;
+
+    if(argc != 3 || strlen(argv[1]) >= MAX_SCENE_NAME){
+        reply(c, "error usage: load NAME FILE|builtin");
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    s = malloc(sizeof(served_scene));
+    strcpy(s->name, argv[1]);
+    if(strcmp(argv[2], "builtin") == 0){
+        setup_scene(&s->sc);
+    } else if(!load_scene(&s->sc, argv[2])){
+        reply(c, "error %s: cannot load it, the server's log says why", argv[2]);
+        free(s);
+        return;
+    }
+    s->view = s->sc.view;
+    s->light = s->sc.light0.location;
+
+    old = find_scene(sv, s->name, &i);
+    if(old != NULL){
+        free_served(old);
+        sv->scenes[i] = s;
+    } else {
+        sv->scenes = realloc(sv->scenes, sizeof(served_scene *) * (sv->scene_count + 1));
+        sv->scenes[sv->scene_count++] = s;
+    }
+    reply(c, "ok %s: %d spheres, %d lights, %d frames in %.3f s", s->name,
+            s->sc.sphere_count, s->sc.light_count, s->sc.anim.frame_count,
+            seconds_since(start));
+}
+
+/*unload NAME*/
+static void unload_request(server * sv, client * c, int argc, char ** argv){
+    served_scene * s;
+    int i;
+    if(argc != 2){
+        reply(c, "error usage: unload NAME");
+        return;
+    }
+    s = find_scene(sv, argv[1], &i);
+    if(s == NULL){
+        reply(c, "error %s: no such scene", argv[1]);
+        return;
+    }
+    free_served(s);
+    sv->scenes[i] = sv->scenes[--sv->scene_count];
+    reply(c, "ok");
+}
+
+/*reads the numbers of a render option into values, false unless there
+ * are count of them*/
+static bool render_numbers(int argc, char ** argv, int * i, double * values, int count){
+    char * end;
+    int n;
+    if(*i + count >= argc){
+        return false;
+    }
+    for(n = 0; n < count; ++n){
+        values[n] = strtod(argv[*i + 1 + n], &end);
+        if(*end != '\0'){
+            return false;
+        }
+    }
+    *i += count;
+    return true;
+}
+
+/*reads "WxH" into width and height, both positive and finite*/
+static bool render_size(int argc, char ** argv, int * i, double * width, double * height){
+    char * end;
+    if(*i + 1 >= argc){
+        return false;
+    }
+    ++*i;
+    *width = strtod(argv[*i], &end);
+    if(*end != 'x'){
+        return false;
+    }
+    *height = strtod(end + 1, &end);
+    return *end == '\0' && *width > 0 && isfinite(*width) && *height > 0
+        && isfinite(*height);
+}
+
+/*render NAME OUTPUT [size WxH] [extent WxH] [center X Y] [light X Y Z]
+ * [depth N] [frame N]: the server's own options, changed by those given,
+ * from the scene's camera and light as loaded*/
+static void render_request(server * sv, client * c, int argc, char ** argv){
+    render_options ropts = *sv->opts;
+    struct timespec start;
+    served_scene * s;
+    double w = ropts.width, h = ropts.height, center[2], light[3], number = 0;
+    bool centered = false, lit = false, depth, ok;
+    int i, frame = 0;
+
+    if(argc < 3){
+        reply(c, "error usage: render NAME OUTPUT [size WxH] [extent WxH] [center X Y] "
+                "[light X Y Z] [depth N] [frame N]");
+        return;
+    }
+    s = find_scene(sv, argv[1], NULL);
+    if(s == NULL){
+        reply(c, "error %s: no such scene", argv[1]);
+        return;
+    }
+    for(i = 3; i < argc; ++i){
+        if(strcmp(argv[i], "size") == 0){
+            /*in range before the whole number test, converting a double
+             * an int cannot hold is undefined*/
+            ok = render_size(argc, argv, &i, &w, &h) && w <= MAX_PIXELS && h <= MAX_PIXELS
+                && w == (int)w && h == (int)h && w * h <= MAX_PIXELS;
+        } else if(strcmp(argv[i], "extent") == 0){
+            ok = render_size(argc, argv, &i, &ropts.extent_width, &ropts.extent_height);
+        } else if(strcmp(argv[i], "center") == 0){
+            ok = centered = render_numbers(argc, argv, &i, center, 2);
+        } else if(strcmp(argv[i], "light") == 0){
+            ok = lit = render_numbers(argc, argv, &i, light, 3);
+        } else if(strcmp(argv[i], "depth") == 0 || strcmp(argv[i], "frame") == 0){
+            depth = strcmp(argv[i], "depth") == 0;
+            ok = render_numbers(argc, argv, &i, &number, 1) && number >= 0
+                && number <= (depth ? MAX_DEPTH : INT_MAX) && number == (int)number;
+            if(ok && depth){
+                ropts.max_depth = (int)number;
+            } else if(ok){
+                frame = (int)number;
+            }
+        } else {
+            ok = false;
+        }
+        if(!ok){
+            reply(c, "error bad render option %s", argv[i]);
+            return;
+        }
+    }
+    if(frame > 0 && frame >= s->sc.anim.frame_count){
+        reply(c, "error %s has %d frames", s->name, s->sc.anim.frame_count);
+        return;
+    }
+    ropts.width = (int)w;
+    ropts.height = (int)h;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    s->sc.view = s->view;
+    s->sc.light0.location = s->light;
+    if(s->sc.anim.frame_count > 0){
+        pose_scene(&s->sc, frame);
+    }
+    if(lit){
+        s->sc.light0.location.x = light[0];
+        s->sc.light0.location.y = light[1];
+        s->sc.light0.location.z = light[2];
+    }
+    configure_scene(&s->sc, &ropts);
+    if(centered){
+        w = s->sc.view.x2 - s->sc.view.x1;
+        h = s->sc.view.y2 - s->sc.view.y1;
+        s->sc.view.x1 = center[0] - w / 2;
+        s->sc.view.x2 = center[0] + w / 2;
+        s->sc.view.y1 = center[1] - h / 2;
+        s->sc.view.y2 = center[1] + h / 2;
+    }
+    resize_renderer(&sv->rd, ropts.width, ropts.height);
+    compute_scene(&sv->rd, &s->sc);
+    ++sv->renders;
+    sv->render_seconds += seconds_since(start);
+    if(!write_image(argv[2], sv->rd.canvas.pixels, sv->rd.canvas.width,
+                sv->rd.canvas.height, sv->rd.canvas.stride)){
+        reply(c, "error %s: %s", argv[2], strerror(errno));
+        return;
+    }
+    reply(c, "ok rendered %dx%d in %.3f s -> %s", ropts.width, ropts.height,
+            seconds_since(start), argv[2]);
+}
+
+/*stats [json]: what the server has done, then the tracing counters and
+ * phase times of all its renders*/
+static void stats_request(server * sv, client * c, int argc, char ** argv){
+    bool json = argc == 2 && strcmp(argv[1], "json") == 0;
+    char * text = NULL;
+    size_t size = 0;
+    FILE * out;
+    int i;
+
+    if(argc > 2 || (argc == 2 && !json)){
+        reply(c, "error usage: stats [json]");
+        return;
+    }
+    out = open_memstream(&text, &size);
+    if(!json){
+        fprintf(out, "requests %lu\nrenders %lu in %.3f s\n", sv->requests, sv->renders,
+                sv->render_seconds);
+        for(i = 0; i < sv->scene_count; ++i){
+            fprintf(out, "scene %s: %d spheres\n", sv->scenes[i]->name,
+                    sv->scenes[i]->sc.sphere_count);
+        }
+    }
+    print_render_stats(out, &sv->rd, json);
+    fclose(out);
+    if(c->fd >= 0 && !write_all(c->fd, text, size)){
+        close(c->fd);
+        c->fd = -1;
+    }
+    free(text);
+    reply(c, "ok");
+}
+
+/*splits line at blanks and answers it*/
+static void serve_request(server * sv, client * c, char * line){
+    char * argv[MAX_ARGUMENTS], * word, * rest;
+    int argc = 0;
+
+    for(word = strtok_r(line, " \t", &rest); word != NULL && argc < MAX_ARGUMENTS;
+            word = strtok_r(NULL, " \t", &rest)){
+        argv[argc++] = word;
+    }
+    if(argc == 0){
+        return;
+    }
+    ++sv->requests;
+    if(strcmp(argv[0], "load") == 0){
+        load_request(sv, c, argc, argv);
+    } else if(strcmp(argv[0], "unload") == 0){
+        unload_request(sv, c, argc, argv);
+    } else if(strcmp(argv[0], "render") == 0){
+        render_request(sv, c, argc, argv);
+    } else if(strcmp(argv[0], "stats") == 0){
+        stats_request(sv, c, argc, argv);
+    } else if(strcmp(argv[0], "quit") == 0){
+        reply(c, "ok");
+        close(c->fd);
+        c->fd = -1;
+    } else if(strcmp(argv[0], "shutdown") == 0){
+        reply(c, "ok");
+        sv->running = false;
+    } else {
+        reply(c, "error unknown request %s", argv[0]);
+    }
+}
+
+static void enqueue(server * sv, int client_id, const char * line, int length){
+    request * r;
+    if(sv->queued == sv->queue_capacity){
+        sv->queue_capacity = sv->queue_capacity > 0 ? 2 * sv->queue_capacity : 16;
+        sv->queue = realloc(sv->queue, sizeof(request) * sv->queue_capacity);
+    }
+    r = &sv->queue[sv->queued++];
+    r->client = client_id;
+    r->line = malloc(length + 1);
+    memcpy(r->line, line, length);
+    r->line[length] = '\0';
+}
+
+/*reads what c has sent and queues each whole line; false when it has
+ * hung up or sent a line too long to be a request*/
+static bool read_client(server * sv, client * c){
+    ssize_t n = recv(c->fd, c->line + c->length, sizeof(c->line) - c->length, 0);
+    char * end;
+    int start = 0, length;
+
+    if(n < 0 && errno == EINTR){
+        return true;
+    }
+    if(n <= 0){
+        return false;
+    }
+    c->length += n;
+    while((end = memchr(c->line + start, '\n', c->length - start)) != NULL){
+        length = end - (c->line + start);
+        if(length > 0 && c->line[start + length - 1] == '\r'){
+            --length;
+        }
+        enqueue(sv, c->id, c->line + start, length);
+        start = end + 1 - c->line;
+    }
+    memmove(c->line, c->line + start, c->length - start);
+    c->length -= start;
+    if(c->length == (int)sizeof(c->line)){
+        reply(c, "error request too long");
+        return false;
+    }
+    return true;
+}
+
+/*takes a waiting connection, refusing it when there are too many*/
+static void accept_client(server * sv, int listener){
+    struct timeval tv = {REPLY_TIMEOUT, 0};
+    client * c;
+    int fd = accept(listener, NULL, NULL);
+
+    if(fd < 0){
+        return;
+    }
+    if(sv->client_count == MAX_CLIENTS){
+        close(fd);
+        return;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    c = &sv->clients[sv->client_count++];
+    c->fd = fd;
+    c->id = sv->next_id++;
+    c->hung_up = false;
+    c->length = 0;
+}
+
+static bool has_requests(const server * sv, const client * c){
+    int i;
+    for(i = 0; i < sv->queued; ++i){
+        if(sv->queue[i].client == c->id){
+            return true;
+        }
+    }
+    return false;
+}
+
+/*answers the oldest queued request, if its connection is still open*/
+static void serve_next(server * sv){
+    request r = sv->queue[0];
+    int i;
+
+    memmove(sv->queue, sv->queue + 1, sizeof(request) * --sv->queued);
+    for(i = 0; i < sv->client_count; ++i){
+        if(sv->clients[i].id == r.client && sv->clients[i].fd >= 0){
+            serve_request(sv, &sv->clients[i], r.line);
+            break;
+        }
+    }
+    free(r.line);
+}
+
+/*serves requests on opts->serve until one asks it to shut down*/
+int run_server(const render_options * opts){
+    struct pollfd fds[MAX_CLIENTS + 1];
+    render_options ropts = *opts;
+    server sv;
+    int listener, i, n;
+
+    /*anyone who can connect can read and overwrite files as this process,
+     * so only a socket file, which its permissions guard, will do*/
+    if(strncmp(opts->serve, "unix:", 5) != 0){
+        fprintf(stderr, "%s: the server only listens on unix:PATH\n", opts->serve);
+        return 1;
+    }
+    listener = open_address(opts->serve, true);
+    if(listener < 0){
+        if(errno != 0){
+            perror(opts->serve);
+        }
+        return 1;
+    }
+    /*whole frames only, there are no light moves to re-shade*/
+    ropts.stream = false;
+    ropts.hit_cache = false;
+    memset(&sv, 0, sizeof(sv));
+    sv.opts = &ropts;
+    sv.running = true;
+    init_renderer(&sv.rd, &ropts);
+    printf("serving on %s with %d threads\n", opts->serve, pool_threads(sv.rd.pool));
+    fflush(stdout);
+
+    while(sv.running){
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for(i = 0; i < sv.client_count; ++i){
+            fds[i + 1].fd = sv.clients[i].hung_up ? -1 : sv.clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        /*with requests waiting only look, do not wait*/
+        n = poll(fds, sv.client_count + 1, sv.queued > 0 ? 0 : -1);
+        if(n < 0 && errno != EINTR){
+            perror("poll");
+            break;
+        }
+        for(i = 0; n > 0 && i < sv.client_count; ++i){
+            if(fds[i + 1].revents != 0 && !read_client(&sv, &sv.clients[i])){
+                sv.clients[i].hung_up = true;
+            }
+        }
+        if(n > 0 && (fds[0].revents & POLLIN)){
+            accept_client(&sv, listener);
+        }
+        if(sv.queued > 0){
+            serve_next(&sv);
+        }
+        /*a connection that hung up is closed once its requests are served*/
+        for(i = n = 0; i < sv.client_count; ++i){
+            client * c = &sv.clients[i];
+            if(c->fd >= 0 && c->hung_up && !has_requests(&sv, c)){
+                close(c->fd);
+                c->fd = -1;
+            }
+            if(c->fd >= 0){
+                sv.clients[n++] = *c;
+            }
+        }
+        sv.client_count = n;
+    }
+
+    for(i = 0; i < sv.client_count; ++i){
+        close(sv.clients[i].fd);
+    }
+    for(i = 0; i < sv.queued; ++i){
+        free(sv.queue[i].line);
+    }
+    for(i = 0; i < sv.scene_count; ++i){
+        free_served(sv.scenes[i]);
+    }
+    free(sv.queue);
+    free(sv.scenes);
+    close_address(listener, opts->serve);
+    destroy_renderer(&sv.rd);
+    printf("served %lu requests, %lu renders\n", sv.requests, sv.renders);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*********************
+ * Reporting of the tracing counters and phase timers.
+ *
+ * phase_end - adds the time since phase_start to a phase
+ * print_stats - writes the counters and timers as text or JSON
+ */
+#include "stats.h"
+
+static const char * phase_names[PHASE_COUNT] = {
+    "setup", "render", "reshade", "display", "pose"
+};
+
+void phase_end(phase_times * times, phase ph, struct timespec start){
+    struct timespec end = phase_start();
+    times->seconds[ph] += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    ++times->calls[ph];
+}
+
+/*the counters in st, in order, and their names*/
+#define COUNTERS(st) \
+    COUNTER(st, rays) COUNTER(st, box_tests) COUNTER(st, sphere_tests) \
+    COUNTER(st, sphere_hits) COUNTER(st, floor_hits) COUNTER(st, phong_evals) \
+    COUNTER(st, shadow_rays) COUNTER(st, shadowed) COUNTER(st, occluder_hits) \
+    COUNTER(st, light_tests) COUNTER(st, light_evals) \
+    COUNTER(st, depth_cap) COUNTER(st, weight_cut) COUNTER(st, aa_rays)
+
+static void print_text(FILE * out, const ray_stats * st, const phase_times * times){
+    int i, deepest = 0;
+
+#ifndef RAYFOO_STATS
+    fprintf(out, "counters: not built in (RAYFOO_STATS)\n");
+#else
+#define COUNTER(st, name) fprintf(out, "%-16s %llu\n", #name, (st)->name);
+    COUNTERS(st)
+#undef COUNTER
+    for(i = 0; i < STATS_DEPTHS; ++i){
+        if(st->rays_by_depth[i] > 0){
+            deepest = i;
+        }
+    }
+    for(i = 0; i <= deepest; ++i){
+        fprintf(out, "rays at depth %-2d%s %llu\n", i, i == STATS_DEPTHS - 1 ? "+" : " ",
+                st->rays_by_depth[i]);
+    }
+#endif
+    for(i = 0; i < PHASE_COUNT; ++i){
+        fprintf(out, "%-16s %.6f s in %lu calls\n", phase_names[i], times->seconds[i],
+                times->calls[i]);
+    }
+}
+
+static void print_json(FILE * out, const ray_stats * st, const phase_times * times){
+    int i;
+
+    fprintf(out, "{");
+#ifdef RAYFOO_STATS
+#define COUNTER(st, name) fprintf(out, "\"%s\": %llu, ", #name, (st)->name);
+    COUNTERS(st)
+#undef COUNTER
+    fprintf(out, "\"rays_by_depth\": [");
+    for(i = 0; i < STATS_DEPTHS; ++i){
+        fprintf(out, "%s%llu", i > 0 ? ", " : "", st->rays_by_depth[i]);
+    }
+    fprintf(out, "], ");
+#endif
+    fprintf(out, "\"phases\": {");
+    for(i = 0; i < PHASE_COUNT; ++i){
+        fprintf(out, "%s\"%s\": {\"seconds\": %.6f, \"calls\": %lu}", i > 0 ? ", " : "",
+                phase_names[i], times->seconds[i], times->calls[i]);
+    }
+    fprintf(out, "}}\n");
+}
+
+/*writes the counters (when built in) and the phase timers to out*/
+void print_stats(FILE * out, const ray_stats * st, const phase_times * times, bool json){
+    if(json){
+        print_json(out, st, times);
+    } else {
+        print_text(out, st, times);
+    }
+}
@@ -0,0 +1,210 @@
+/*********************
+ * Wavefront (breadth first) engine, an alternative to the recursive
+ * cast_ray producing the same image.
+ *
+ * A pixel's color is the sum over its path of the Phong color of every
+ * sphere hit, scaled by the product of the reflectivities before it, so
+ * each queued ray carries that product as its weight and adds its share
+ * straight into the canvas.
+ *
+ * trace_wavefront - traces a queue of primary rays bounce by bounce
+ * sort_queue - orders a bounce by direction octant and then by origin
+ *                  along a Morton curve
+ */
+#include "wavefront.h"
+#include "gbuffer.h"
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*bits per axis of the quantized origin in the sort key*/
+#define MORTON_BITS 10
+#define INDEX_BITS 31
+
+void init_wavefront(wavefront * wf, size_t capacity){
+    wf->current = malloc(sizeof(wave_ray) * capacity);
+    wf->next = malloc(sizeof(wave_ray) * capacity);
+    wf->hit = malloc(sizeof(hit_record) * capacity);
+    wf->keys = malloc(sizeof(uint64_t) * capacity);
+    wf->capacity = capacity;
+}
+
+void free_wavefront(wavefront * wf){
+    free(wf->current);
+    free(wf->next);
+    free(wf->hit);
+    free(wf->keys);
+    memset(wf, 0, sizeof(wavefront));
+}
+
+/*spreads the low 10 bits of v out to every third bit*/
+static uint64_t spread_bits(uint64_t v){
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+/*quantizes v in [lo, lo + 1/scale] to MORTON_BITS bits*/
+static uint64_t quantize(double v, double lo, double scale){
+    double q = (v - lo) * scale;
+    if(q < 0){
+        return 0;
+    }
+    return q > (1 << MORTON_BITS) - 1 ? (1 << MORTON_BITS) - 1 : (uint64_t)q;
+}
+
+static int compare_keys(const void * a, const void * b){
+    uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+    return ka < kb ? -1 : ka > kb;
+}
+
+/*sorts the n rays of wf->next into wf->current so rays in the same
+ * direction octant starting close together are neighbours in the queue*/
+static void sort_queue(wavefront * wf, int n){
+    point lo, hi;
+    double sx, sy, sz, range = (1 << MORTON_BITS) - 1;
+    int i;
+
+    if(n == 0){
+        return;
+    }
+    lo = hi = wf->next[0].r.orgin;
+    for(i = 1; i < n; ++i){
+        point o = wf->next[i].r.orgin;
+        lo.x = fmin(lo.x, o.x);
+        lo.y = fmin(lo.y, o.y);
+        lo.z = fmin(lo.z, o.z);
+        hi.x = fmax(hi.x, o.x);
+        hi.y = fmax(hi.y, o.y);
+        hi.z = fmax(hi.z, o.z);
+    }
+    sx = hi.x > lo.x ? range / (hi.x - lo.x) : 0;
+    sy = hi.y > lo.y ? range / (hi.y - lo.y) : 0;
+    sz = hi.z > lo.z ? range / (hi.z - lo.z) : 0;
+
+    for(i = 0; i < n; ++i){
+        const wave_ray * w = &wf->next[i];
+        vector d = ray_to_vector(w->r);
+        uint64_t octant = (d.x < 0) | (d.y < 0) << 1 | (d.z < 0) << 2;
+        uint64_t morton = spread_bits(quantize(w->r.orgin.x, lo.x, sx))
+                | spread_bits(quantize(w->r.orgin.y, lo.y, sy)) << 1
+                | spread_bits(quantize(w->r.orgin.z, lo.z, sz)) << 2;
+        wf->keys[i] = octant << (3 * MORTON_BITS + INDEX_BITS)
+                | morton << INDEX_BITS | (uint64_t)i;
+    }
+    qsort(wf->keys, n, sizeof(uint64_t), compare_keys);
+
+    for(i = 0; i < n; ++i){
+        wf->current[i] = wf->next[wf->keys[i] & (((uint64_t)1 << INDEX_BITS) - 1)];
+    }
+}
+
+#ifdef RAYFOO_STATS
+/*counts a reflection of the last bounce the way cast_ray would: cut by
+ * the depth cap if it was heavy enough to cast (returning true), otherwise
+ * by its weight*/
+static bool count_cut(tracer * tr, double weight){
+    if(weight >= tr->sc->min_weight){
+        ++tr->stats.depth_cap;
+        return true;
+    }
+    ++tr->stats.weight_cut;
+    return false;
+}
+#endif
+
+/*traces the n primary rays queued in wf->current, writing every pixel
+ * they belong to in canvas*/
+void trace_wavefront(wavefront * wf, tracer * tr, int n, color * canvas){
+    const scene * sc = tr->sc;
+    color black = {BLACK};
+    vector up = {0, 1, 0}, normal, view;
+    int depth;
+    int i, m;
+
+    for(i = 0; i < n; ++i){
+        canvas[wf->current[i].pixel] = black;
+        gbuffer_clear(tr->cache, wf->current[i].pixel);
+        if(tr->first_hit != NULL){
+            tr->first_hit[wf->current[i].pixel] = NULL;
+        }
+    }
+
+    for(depth = 0; n > 0 && depth < sc->max_ray_depth; ++depth){
+        bool last = depth + 1 >= sc->max_ray_depth;
+
+        /*intersect the whole queue*/
+        STAT(tr->stats.rays_by_depth[stats_depth(depth)] += n);
+        for(i = 0; i < n; ++i){
+            closest_sphere(tr, wf->current[i].r, &wf->hit[i]);
+        }
+        if(depth == 0 && tr->first_hit != NULL){
+            for(i = 0; i < n; ++i){
+                tr->first_hit[wf->current[i].pixel] = wf->hit[i].index >= 0
+                    ? hit_sphere(sc, &wf->hit[i]) : NULL;
+            }
+        }
+
+        /*shade it, queueing the reflections of the next bounce*/
+        m = 0;
+        for(i = 0; i < n; ++i){
+            const wave_ray * w = &wf->current[i];
+            const hit_record * h = &wf->hit[i];
+            const sphere_list * sl;
+            point p;
+            color c;
+            double keep;
+
+            if(h->index < 0){
+                /*the floor is a perfect mirror, anything else leaves the scene*/
+                if(w->r.at.y - w->r.orgin.y >= 0){
+                    continue;
+                }
+                if(last){
+                    STAT(tr->stats.floor_hits += count_cut(tr, w->weight));
+                } else if((keep = continue_path(tr, w->weight, w->pixel,
+                                depth + 1)) > 0){
+                    STAT(++tr->stats.floor_hits);
+                    p = find_y_plane_intersection(w->r, sc->floor);
+                    wf->next[m].r = reflect_ray(w->r, p, up);
+                    wf->next[m].weight = w->weight * keep;
+                    wf->next[m++].pixel = w->pixel;
+                } else {
+                    STAT(++tr->stats.weight_cut);
+                }
+                continue;
+            }
+
+            sl = hit_sphere(sc, h);
+            p = parametric_ray(w->r, h->t);
+            normal = hit_normal(sc, h, p);
+            view = normalize_vector(points_to_vector(p, w->r.orgin));
+            c = light_hit(tr, sl, p, normal, view);
+            gbuffer_record(tr->cache, w->pixel, sl, p, normal, view, w->weight);
+            canvas[w->pixel].r += w->weight * c.r;
+            canvas[w->pixel].g += w->weight * c.g;
+            canvas[w->pixel].b += w->weight * c.b;
+
+            if(sl->reflectivity <= 0){
+                continue;
+            }
+            if(last){
+                STAT(count_cut(tr, w->weight * sl->reflectivity));
+            } else if((keep = continue_path(tr, w->weight * sl->reflectivity, w->pixel,
+                        depth + 1)) > 0){
+                wf->next[m].r = reflect_ray(w->r, p, normal);
+                wf->next[m].weight = w->weight * sl->reflectivity * keep;
+                wf->next[m++].pixel = w->pixel;
+            } else {
+                STAT(++tr->stats.weight_cut);
+            }
+        }
+
+        sort_queue(wf, m);
+        n = m;
+    }
+}